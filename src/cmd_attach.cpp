@@ -33,6 +33,7 @@ public:
     {
         _options.add_options()("help", "show help message");
         _options.add_options()("pid,p", po::value<pid_t>(), "target process pid");
+        _options.add_options()("backend,b", po::value<std::string>()->default_value("vm"), "memory access: vm (process_vm_readv), mem (/proc/pid/mem)");
         _posiginal.add("pid", 1);
     }
     
@@ -57,12 +58,28 @@ public:
         return command == "selfattach" or command == "attach";
     }
 
-    void attach(pid_t pid)
+    void attach(pid_t pid, const std::string& backend = "vm")
     {
+        using namespace tui::attributes;
+
+        try {
+            if (backend == "mem") {
+                _app._process = std::make_shared<ProcessLinuxMem>(pid);
+            } else if (backend == "vm") {
+                _app._process = std::make_shared<ProcessLinux>(pid);
+            } else {
+                throw std::invalid_argument("unknown backend: " + backend);
+            }
+        } catch (const std::exception& e) {
+            message()
+                << EnableStyle(AttrUnderline) << SetColor(ColorError) << "Error: " << ResetStyle()
+                << e.what();
+            show();
+            return;
+        }
+
         message() << "Attach process " << pid;
         show();
-
-        _app._process = std::make_shared<ProcessLinux>(pid);
     }
 
     void run(const std::string& command, const std::vector<std::string>& arguments) override
@@ -75,11 +92,13 @@ public:
         PROGRAM_OPTIONS();
 
         pid_t pid = -1;
+        std::string backend {};
 
         try {
             if (opts.count("pid")) {
                 pid = opts["pid"].as<pid_t>();
             }
+            backend = opts["backend"].as<std::string>();
         } catch (const std::exception& e) {
             message()
                 << EnableStyle(AttrUnderline) << SetColor(ColorError) << "Error: " << ResetStyle()
@@ -96,7 +115,7 @@ public:
             return;
         }
 
-        attach(pid);
+        attach(pid, backend);
     }
 };
 
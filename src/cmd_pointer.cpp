@@ -18,34 +18,116 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "mathexpr.hpp"
 #include "mypower.hpp"
-#include "scanner.hpp"
+#include "pointermap.hpp"
 
 namespace po = boost::program_options;
 using namespace std::string_literals;
 
 namespace mypower {
 
-struct GotIt : public std::logic_error {
-    using std::logic_error::logic_error;
-};
+/*
+    Chains found by the pointer command. 'r' resolves every chain again in
+    the process, level by level with one batched read per level, and drops
+    the chains that no longer end at their target.
+*/
+class PointerChainView : public SessionView {
+    std::shared_ptr<Process> _process;
+    std::string _name;
+    std::vector<PointerChain> _chains {};
+    // where each chain ended when it was resolved last
+    std::vector<uintptr_t> _resolved {};
 
-struct PointerConfig {
-    uintptr_t begin;
-    uintptr_t end;
-    uintptr_t mask;
-    size_t step;
-    size_t depth_max;
-    size_t offset_max;
-    size_t result_max;
-    bool find_all;
-};
+public:
+    PointerChainView(std::shared_ptr<Process>& process, const std::string& name)
+        : _process(process)
+        , _name(name)
+    {
+    }
 
-struct PointerInfo {
-    uintptr_t _pointer;
-    uintptr_t _value{0};
-    uintptr_t _offset{0};
-    size_t _depth{0};
-    PointerInfo* _prev{nullptr};
+    void add(const PointerChain& chain)
+    {
+        _chains.push_back(chain);
+        _resolved.push_back(chain._target);
+    }
+
+    // returns the number of chains dropped
+    size_t revalidate()
+    {
+        std::vector<const PointerChain*> chains {};
+        chains.reserve(_chains.size());
+        for (auto& chain : _chains) {
+            chains.push_back(&chain);
+        }
+
+        _resolved = resolve_chains(*_process, chains);
+
+        size_t count = 0;
+        for (size_t idx = 0; idx < _chains.size(); ++idx) {
+            if (_resolved[idx] == _chains[idx]._target) {
+                if (count != idx) {
+                    _chains[count] = std::move(_chains[idx]);
+                }
+                _resolved[count] = _resolved[idx];
+                count += 1;
+            }
+        }
+        auto dropped = _chains.size() - count;
+        _chains.resize(count);
+        _resolved.resize(count);
+        return dropped;
+    }
+
+    const std::string session_name() override
+    {
+        return _name;
+    }
+
+    void session_name(const std::string& name) override
+    {
+        _name = name;
+    }
+
+    void session_reset() override
+    {
+        _chains.clear();
+        _resolved.clear();
+    }
+
+    AttributedString tui_title(size_t width) override
+    {
+        return AttributedString::layout("Pointers: "s + _name + " #"s + std::to_string(_chains.size()), width, 1, '+', LayoutAlign::Center);
+    }
+
+    AttributedString tui_item(size_t index, size_t width) override
+    {
+        // 0xBASE -> OFFSET ... = 0xTARGET
+        using namespace tui::attributes;
+        AttributedStringBuilder builder {};
+
+        auto& chain = _chains.at(index);
+        builder << std::hex << SetColor(ColorInfo) << "0x" << chain.base() << ResetStyle();
+        for (auto offset : chain._offsets) {
+            builder << " -> 0x" << offset;
+        }
+        builder << " = " << SetColor(ColorPrompt) << "0x" << _resolved.at(index) << ResetStyle();
+        return builder.release();
+    }
+
+    size_t tui_count() override
+    {
+        return _chains.size();
+    }
+
+    bool tui_key(size_t index, int key) override
+    {
+        switch (key) {
+        case 'r':
+            revalidate();
+            this->tui_notify_changed();
+            return true;
+        }
+        return false;
+    }
 };
 
 class CommandPointer : public Command {
@@ -59,16 +141,20 @@ public:
         _options.add_options()("help", "show help message");
         _options.add_options()("begin", po::value<std::string>(), "target region start");
         _options.add_options()("end", po::value<std::string>(), "target region end");
-        _options.add_options()("pointer", po::value<std::string>(), "pointer");
-        _options.add_options()("mask", po::value<std::string>(), "mask");
+        _options.add_options()("pointer", po::value<std::vector<std::string>>()->multitoken(), "pointers to search chains to, in one pass");
         _options.add_options()("depth-max", po::value<size_t>()->default_value(5), "depth max");
         _options.add_options()("offset-max", po::value<size_t>()->default_value(1024), "struct offset max");
-        _options.add_options()("result-max", po::value<size_t>()->default_value(1024), "result max");
+        _options.add_options()("result-max", po::value<size_t>()->default_value(1024), "skip addresses with more pointers to them");
+        _options.add_options()("node-max", po::value<size_t>()->default_value(size_t(1) << 24), "stop when holding this many addresses");
+        _options.add_options()("time-max", po::value<size_t>()->default_value(0), "stop after this many seconds, 0 for no limit");
         _options.add_options()("step", po::value<size_t>()->default_value(sizeof(uintptr_t)), "step size");
         _options.add_options()("all", po::bool_switch()->default_value(false), "find all");
+        _options.add_options()("name,n", po::value<std::string>(), "session name");
+        _options.add_options()("save-map", po::value<std::string>(), "save the pointer map and the search to a file");
+        _options.add_options()("intersect", po::value<std::vector<std::string>>()->multitoken(), "chains of the first saved map that resolve in all of them");
         _posiginal.add("begin", 1);
         _posiginal.add("end", 1);
-        _posiginal.add("pointer", 1);
+        _posiginal.add("pointer", -1);
     }
     
     void show_short_help() override
@@ -81,101 +167,121 @@ public:
         return command == "ptr" or command == "pointer";
     }
 
-    static const std::string_view pad(size_t depth) {
-        if (depth < 10) {
-            return { "                    ", depth * 2 };
-        }
-        return { "    <Level >= 10>    ", 21 };
-    }
-
-    void print_path(PointerInfo& ptr) {
-        auto depth = ptr._depth;
-        auto* p = &ptr;
-        while (p != nullptr) {
-            if (p->_prev) {
-                message() 
-                    << pad(depth - p->_depth)
-                    << (void*)p->_pointer
-                    << " Value: " << (void*)p->_value
-                    << " Offset: " << p->_offset;
-            } else {
-                message() 
-                    << pad(depth - p->_depth)
-                    << attributes::SetColor(attributes::ColorInfo)
-                    << (void*)p->_pointer;
-            }
-            p = p->_prev;
+    void print_status(PointerSearch::Status status)
+    {
+        using namespace tui::attributes;
+
+        if (status == PointerSearch::Status::NodeLimit) {
+            message() << SetColor(ColorWarning) << "Stopped: node-max reached";
+        } else if (status == PointerSearch::Status::TimeLimit) {
+            message() << SetColor(ColorWarning) << "Stopped: time-max reached";
         }
     }
 
-    void find_ref(PointerInfo& ptr, PointerConfig& config) 
+    /*
+        Searches the first map for the search saved with it, then follows
+        every chain from the same module offset in the other maps. Only the
+        chains that end at the same target of every map are kept, targets
+        are matched by their position in the saved list.
+    */
+    void intersect(const std::vector<std::string>& files, PointerSearch::Config config)
     {
-        if (ptr._depth >= config.depth_max) {
-            return;
+        std::vector<PointerMap> maps(files.size());
+        for (size_t idx = 0; idx < files.size(); ++idx) {
+            maps[idx].load(files[idx]);
+        }
+
+        auto& first = maps.front();
+        for (auto& map : maps) {
+            if (map.targets().size() != first.targets().size()) {
+                throw std::invalid_argument("the maps are saved for different numbers of targets");
+            }
         }
 
-        Session session{_app._process, 8 * 1024 * 1024};
+        config._begin = first.begin();
+        config._end = first.end();
+        config._find_all = true;
 
-        session.update_memory_region();
-        
-        session.scan(ScanComparator<ComparatorMask<uintptr_t>>{ { ptr._pointer, config.mask }, config.step }, kRegionFlagReadWrite);
+        message()
+            << "From: " << (void*)first.begin() << "-" << (void*)first.end()
+            << " Targets: " << first.targets().size()
+            << " Maps: " << maps.size();
 
-        // slow
-        // session.scan(ScanComparator<ComparatorRange<uintptr_t>>{ { ptr._pointer - config.offset_max, ptr._pointer }, config.step }, kRegionFlagReadWrite);
+        std::vector<PointerChain> chains {};
+        PointerSearch search { first, config };
+        auto status = search.run(first.targets(), [&](const PointerChain& chain) {
+            chains.push_back(chain);
+        });
 
-        if (session.U64_size() > config.result_max) {
-            message() << pad(ptr._depth) << "Too many result " << session.U64_size();
-            return;
+        std::vector<std::string> modules(chains.size());
+        std::vector<uintptr_t> offsets(chains.size());
+        std::vector<size_t> targets(chains.size());
+        std::vector<bool> alive(chains.size());
+        for (size_t idx = 0; idx < chains.size(); ++idx) {
+            alive[idx] = first.module_offset(chains[idx].base(), modules[idx], offsets[idx]);
+            targets[idx] = std::find(first.targets().begin(), first.targets().end(), chains[idx]._target) - first.targets().begin();
         }
 
-        std::sort(session.U64_begin(), session.U64_end(), [=](const MatchU64& a, const MatchU64& b){
-            auto x = ptr._pointer - a._value;
-            auto y = ptr._pointer - b._value;
-            return x < y;
-        });
-        
-        for (auto iter = session.U64_begin(); iter != session.U64_end(); ++iter) {
-            if (iter->_value > ptr._pointer) {
-                break;
+        std::vector<uintptr_t> bases {};
+        std::vector<const PointerChain*> pending {};
+        std::vector<size_t> indexes {};
+
+        for (size_t map = 1; map < maps.size(); ++map) {
+            bases.clear();
+            pending.clear();
+            indexes.clear();
+
+            for (size_t idx = 0; idx < chains.size(); ++idx) {
+                uintptr_t base = 0;
+                if (alive[idx] and maps[map].module_address(modules[idx], offsets[idx], base)) {
+                    bases.push_back(base);
+                    pending.push_back(&chains[idx]);
+                    indexes.push_back(idx);
+                } else {
+                    alive[idx] = false;
+                }
             }
 
-            if (iter->_addr.get() >= config.begin and iter->_addr.get() < config.end) {
-                PointerInfo next{};
-                next._pointer = iter->_addr.get();
-                next._value = iter->_value;
-                next._depth = ptr._depth + 1;
-                next._offset = ptr._pointer - iter->_value;
-                next._prev = &ptr;
-                print_path(next);
-
-                if (not config.find_all) {
-                    throw GotIt("got it");
+            auto ends = maps[map].follow(bases, pending);
+            for (size_t idx = 0; idx < ends.size(); ++idx) {
+                if (ends[idx] != maps[map].targets()[targets[indexes[idx]]]) {
+                    alive[indexes[idx]] = false;
                 }
-                continue;
             }
+        }
 
-            if ((ptr._pointer - iter->_value) < config.offset_max) {
-                PointerInfo next{};
-                next._pointer = iter->_addr.get();
-                next._value = iter->_value;
-                next._depth = ptr._depth + 1;
-                next._offset = ptr._pointer - iter->_value;
-                next._prev = &ptr;
-                find_ref(next, config);
+        size_t count = 0;
+        for (size_t idx = 0; idx < chains.size(); ++idx) {
+            if (not alive[idx]) {
+                continue;
+            }
+            std::ostringstream oss {};
+            oss << modules[idx] << std::hex << "+0x" << offsets[idx];
+            for (auto offset : chains[idx]._offsets) {
+                oss << " -> 0x" << offset;
             }
+            if (first.targets().size() > 1) {
+                oss << std::dec << " [target " << targets[idx] << "]";
+            }
+            message() << oss.str();
+            count += 1;
         }
+
+        print_status(status);
+        message() << "Chains: " << count << " of " << chains.size();
     }
 
     void run(const std::string& command, const std::vector<std::string>& arguments) override
     {
         PROGRAM_OPTIONS();
-        uintptr_t pointer { 0 };
-        uintptr_t mask { 0 };
+        std::vector<uintptr_t> pointers {};
         uintptr_t begin { 0 };
         uintptr_t end { 0 };
         size_t depth_max { 0 };
         size_t offset_max { 0 };
         size_t result_max { 0 };
+        size_t node_max { 0 };
+        size_t time_max { 0 };
         size_t step { sizeof(void*) };
 
         if (opts.count("help")) {
@@ -192,16 +298,15 @@ public:
                 end = mathexpr::parse_address_or_throw(opts["end"].as<std::string>());
             }
             if (opts.count("pointer")) {
-                pointer = mathexpr::parse_address_or_throw(opts["pointer"].as<std::string>());
-            }
-            if (opts.count("mask")) {
-                mask = mathexpr::parse_address_or_throw(opts["mask"].as<std::string>());
-            } else {
-                mask = UINTPTR_MAX - 0x3FF;
+                for (auto& pointer : opts["pointer"].as<std::vector<std::string>>()) {
+                    pointers.push_back(mathexpr::parse_address_or_throw(pointer));
+                }
             }
             depth_max = opts["depth-max"].as<size_t>();
             offset_max = opts["offset-max"].as<size_t>();
             result_max = opts["result-max"].as<size_t>();
+            node_max = opts["node-max"].as<size_t>();
+            time_max = opts["time-max"].as<size_t>();
             step = opts["step"].as<size_t>();
 
         } catch (const std::exception& e) {
@@ -212,30 +317,71 @@ public:
             return;
         }
 
-        PointerConfig config;
-        config.begin = begin;
-        config.end = end;
-        config.mask = mask;
-        config.step = step;
-        config.depth_max = depth_max;
-        config.offset_max = offset_max;
-        config.result_max = result_max;
-        config.find_all = opts["all"].as<bool>();
+        PointerSearch::Config config {};
+        config._begin = begin;
+        config._end = end;
+        config._depth_max = depth_max;
+        config._offset_max = offset_max;
+        config._fanout_max = result_max;
+        config._node_max = node_max;
+        config._time_max = std::chrono::seconds(time_max);
+        config._find_all = opts["all"].as<bool>();
+
+        auto t0 = std::chrono::system_clock::now();
+
+        if (opts.count("intersect")) {
+            try {
+                intersect(opts["intersect"].as<std::vector<std::string>>(), config);
+            } catch (const std::exception& e) {
+                message()
+                    << EnableStyle(AttrUnderline) << SetColor(ColorError) << "Error: " << ResetStyle()
+                    << e.what();
+                show();
+                return;
+            }
+
+            auto d = std::chrono::system_clock::now() - t0;
+            message() << "Time: " << std::chrono::duration_cast<std::chrono::seconds>(d).count() << "s";
+            return;
+        }
 
-        PointerInfo ptr_info{};
-        ptr_info._pointer = pointer;
+        if (pointers.empty()) {
+            message()
+                << "Usage: " << command << " [options] begin end pointer...\n"
+                << _options;
+            show();
+            return;
+        }
 
         message() 
             << "From: " << (void*)begin << "-" << (void*)end 
-            << " To: " << EnableStyle(AttrUnderline) << SetColor(ColorInfo) << (void*)pointer;
+            << " To: " << EnableStyle(AttrUnderline) << SetColor(ColorInfo) << (void*)pointers.front()
+            << ResetStyle() << (pointers.size() > 1 ? " and " + std::to_string(pointers.size() - 1) + " more" : "");
+
+        std::ostringstream name {};
+        if (opts.count("name")) {
+            name << opts["name"].as<std::string>();
+        } else {
+            name << "ptr " << (void*)pointers.front();
+        }
 
-        auto t0 = std::chrono::system_clock::now();
+        PointerMap map {};
+        auto view = std::make_shared<PointerChainView>(_app._process, name.str());
+        auto status = PointerSearch::Status::Done;
 
         try {
-            find_ref(ptr_info, config);
-        } catch (const GotIt&) {
-            // do nothing
+            map.build(_app._process, step);
+            message() << "Pointers: " << map.size();
 
+            if (opts.count("save-map")) {
+                map.save(opts["save-map"].as<std::string>(), pointers, begin, end);
+                message() << "Saved: " << opts["save-map"].as<std::string>();
+            }
+
+            PointerSearch search { map, config };
+            status = search.run(pointers, [&](const PointerChain& chain) {
+                view->add(chain);
+            });
         } catch (const std::exception& e) {
             message()
                 << EnableStyle(AttrUnderline) << SetColor(ColorError) << "Error: " << ResetStyle()
@@ -244,8 +390,20 @@ public:
             return;
         }
 
+        print_status(status);
+
         auto d = std::chrono::system_clock::now() - t0;
+        message() << "Chains: " << view->tui_count();
         message() << "Time: " << std::chrono::duration_cast<std::chrono::seconds>(d).count() << "s";
+
+        if (view->tui_count() == 0) {
+            show();
+            return;
+        }
+
+        _app._session_views.emplace_back(view);
+        _app._current_session_view = view;
+        show(view);
     }
 };
 
@@ -185,14 +185,12 @@ public:
 
             VMAddress addr{addr_number_ast->_value};
 
-            for(auto iter = regions.begin(); iter != regions.end();) {
-                if (addr >= iter->_begin and addr < iter->_end) {
-                    iter ++;
-                } else {
-                    iter = regions.erase(iter);
-                }
+            auto index = RegionIndex { regions }.find(addr.get());
+            VMRegion::ListType found {};
+            if (index != RegionIndex::npos) {
+                found.push_back(std::move(regions[index]));
             }
-            show(std::make_shared<RegionListView>(std::move(regions)));
+            show(std::make_shared<RegionListView>(std::move(found)));
             return;
         }
 
@@ -59,7 +59,7 @@ public:
         std::shared_ptr<Process>& process,
         const std::string& name,
         const std::string& expr)
-        : _session(process, 8 * 1024 * 1024)
+        : _session(process)
         , _name(name)
         , _expr(expr)
     {
@@ -158,38 +158,38 @@ public:
 };
 
 template <typename T>
-static void scan_fast(Session& session, dsl::ComparatorType opr, uintptr_t constant1, uintptr_t constant2, const ScanArgs& args)
+static void scan_fast(ScanMultiple& scanner, dsl::ComparatorType opr, uintptr_t constant1, uintptr_t constant2, const ScanArgs& args)
 {
     switch (opr) {
     case dsl::ComparatorType::EQ_Expr:
-        session.scan(ScanComparator<ComparatorEqual<T>> { { static_cast<T>(constant1) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorEqual<T>> { { static_cast<T>(constant1) }, args._step });
         break;
     case dsl::ComparatorType::NE_Expr:
-        session.scan(ScanComparator<ComparatorNotEqual<T>> { { static_cast<T>(constant1) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorNotEqual<T>> { { static_cast<T>(constant1) }, args._step });
         break;
     case dsl::ComparatorType::GT_Expr:
-        session.scan(ScanComparator<ComparatorGreaterThen<T>> { { static_cast<T>(constant1) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorGreaterThen<T>> { { static_cast<T>(constant1) }, args._step });
         break;
     case dsl::ComparatorType::GE_Expr:
-        session.scan(ScanComparator<ComparatorGreaterOrEqual<T>> { { static_cast<T>(constant1) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorGreaterOrEqual<T>> { { static_cast<T>(constant1) }, args._step });
         break;
     case dsl::ComparatorType::LT_Expr:
-        session.scan(ScanComparator<ComparatorLessThen<T>> { { static_cast<T>(constant1) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorLessThen<T>> { { static_cast<T>(constant1) }, args._step });
         break;
     case dsl::ComparatorType::LE_Expr:
-        session.scan(ScanComparator<ComparatorLessOrEqual<T>> { { static_cast<T>(constant1) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorLessOrEqual<T>> { { static_cast<T>(constant1) }, args._step });
         break;
     case dsl::ComparatorType::EQ_Mask:
-        session.scan(ScanComparator<ComparatorMask<T>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorMask<T>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step });
         break;
     case dsl::ComparatorType::NE_Mask:
-        session.scan(ScanComparator<ComparatorMask<T, true>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorMask<T, true>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step });
         break;
     case dsl::ComparatorType::EQ_Range:
-        session.scan(ScanComparator<ComparatorRange<T>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorRange<T>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step });
         break;
     case dsl::ComparatorType::NE_Range:
-        session.scan(ScanComparator<ComparatorRange<T, true>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanComparator<ComparatorRange<T, true>> { { static_cast<T>(constant1), static_cast<T>(constant2) }, args._step });
         break;
     default:
         assert(false && "Fast mode does not support this operator");
@@ -197,11 +197,11 @@ static void scan_fast(Session& session, dsl::ComparatorType opr, uintptr_t const
 }
 
 template <typename T>
-static void scan(const ScanArgs& args, bool fast_mode, Session& session, dsl::ComparatorExpression& comparator)
+static void scan(const ScanArgs& args, bool fast_mode, ScanMultiple& scanner, dsl::ComparatorExpression& comparator)
 {
     if (fast_mode) {
         scan_fast<T>(
-            session,
+            scanner,
             comparator._comparator,
             comparator._constant1.value_or(0),
             comparator._constant2.value_or(0),
@@ -209,7 +209,7 @@ static void scan(const ScanArgs& args, bool fast_mode, Session& session, dsl::Co
 
     } else { // JIT
         auto code = comparator.compile();
-        session.scan(ScanExpression<T, dsl::JITCode> { std::move(code), args._step }, args._prot, args._exclude_file);
+        scanner.add(ScanExpression<T, dsl::JITCode> { std::move(code), args._step });
     }
 }
 
@@ -223,6 +223,8 @@ std::shared_ptr<SessionView> scan(
     AutoSuspendResume suspend { process, args._suspend_same_user, process->pid() != ::getpid() };
 
     view->_session.update_memory_region();
+    view->_session.present_pages_only(args._present_only);
+    view->_session.track_dirty_pages(args._soft_dirty);
 
     if (args._type_bits & MatchTypeBitNumberMask) {
         size_t data_size = 0;
@@ -261,6 +263,21 @@ std::shared_ptr<SessionView> scan(
                 << " bytes";
         }
 
+        if (args._unknown) {
+            view->_session.scan_unknown(args._type_bits & MatchTypeBitNumberMask, args._step, args._prot, args._exclude_file);
+
+            auto& snapshot = view->_session.snapshot();
+            message_view->stream()
+                << attributes::SetColor(attributes::ColorInfo)
+                << "Snapshot: "
+                << attributes::ResetStyle()
+                << (snapshot.size() >> 20) << " MB, compressed "
+                << (snapshot.compressed_size() >> 20) << " MB";
+
+            view->tui_notify_changed();
+            return view;
+        }
+
         auto comparator = dsl::parse_comparator_expression(args._expr);
         bool fast_mode { false };
 
@@ -308,46 +325,50 @@ std::shared_ptr<SessionView> scan(
             return nullptr;
         }
 
+        ScanMultiple scanner { args._step };
+
         if (args._type_bits & MatchTypeBitI8) {
-            scan<int8_t>(args, fast_mode, view->_session, comparator);
+            scan<int8_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitU8) {
-            scan<uint8_t>(args, fast_mode, view->_session, comparator);
+            scan<uint8_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitI16) {
-            scan<int16_t>(args, fast_mode, view->_session, comparator);
+            scan<int16_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitU16) {
-            scan<uint16_t>(args, fast_mode, view->_session, comparator);
+            scan<uint16_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitI32) {
-            scan<int32_t>(args, fast_mode, view->_session, comparator);
+            scan<int32_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitU32) {
-            scan<uint32_t>(args, fast_mode, view->_session, comparator);
+            scan<uint32_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitI64) {
-            scan<int64_t>(args, fast_mode, view->_session, comparator);
+            scan<int64_t>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitU64) {
-            scan<uint64_t>(args, fast_mode, view->_session, comparator);
+            scan<uint64_t>(args, fast_mode, scanner, comparator);
         }
     
         if (args._type_bits & MatchTypeBitFLOAT) {
-            scan<float>(args, fast_mode, view->_session, comparator);
+            scan<float>(args, fast_mode, scanner, comparator);
         }
 
         if (args._type_bits & MatchTypeBitDOUBLE) {
-            scan<double>(args, fast_mode, view->_session, comparator);
+            scan<double>(args, fast_mode, scanner, comparator);
         }
 
+        view->_session.scan(scanner, args._prot, args._exclude_file);
+
     } else if (args._c_string) {
         view->_session.scan(ScanBytes { typeBYTES { args._expr.begin(), args._expr.end() } }, args._prot, args._exclude_file);
 
@@ -409,6 +430,23 @@ bool filter(
     RefreshView refresh(session_view);
     auto* view = dynamic_cast<SessionViewImpl*>(session_view.get());
 
+    if (view == nullptr) {
+        message_view->stream()
+            << attributes::SetColor(attributes::ColorError)
+            << "Error:"
+            << attributes::ResetStyle()
+            << " Session " << session_view->session_name() << " holds no matches to filter";
+        return false;
+    }
+
+    if (auto dropped = view->_session.refresh_memory_region()) {
+        message_view->stream()
+            << attributes::SetColor(attributes::ColorInfo)
+            << "Unmapped: "
+            << attributes::ResetStyle()
+            << dropped << " matches dropped";
+    }
+
     auto comparator = dsl::parse_comparator_expression(args._expr);
     bool fast_mode { false };
 
@@ -507,8 +545,11 @@ public:
         _options.add_options()("DOUBLE,d", po::bool_switch()->default_value(false), "double");
         _options.add_options()("exec,x", po::bool_switch()->default_value(false), "scan executable memory");
         _options.add_options()("exclude-file", po::bool_switch()->default_value(false), "exclude file");
+        _options.add_options()("soft-dirty", po::bool_switch()->default_value(false), "filters only read the pages written since the last scan or filter");
+        _options.add_options()("present-only", po::bool_switch()->default_value(false), "skip anonymous pages that are not present or map the zero page");
         _options.add_options()("write,w", po::bool_switch()->default_value(false), "scan writable memory");
         _options.add_options()("cstr,c", po::bool_switch()->default_value(false), "C string");
+        _options.add_options()("unknown,u", po::bool_switch()->default_value(false), "unknown initial value, the first filter compares against a snapshot");
         _options.add_options()("expr", po::value<std::string>(), "scan expression");
         _options.add_options()("name,n", po::value<std::string>(), "session name");
         _posiginal.add("expr", 1);
@@ -530,8 +571,12 @@ public:
                 args._expr = opts["expr"].as<std::string>();
             }
 
+            args._unknown = opts["unknown"].as<bool>();
+
             if (opts.count("name")) {
                 args._name = opts["name"].as<std::string>();
+            } else if (args._unknown) {
+                args._name = "unknown";
             } else {
                 args._name = args._expr;
             }
@@ -552,6 +597,9 @@ public:
 
             args._exclude_file = opts["exclude-file"].as<bool>();
 
+            args._present_only = opts["present-only"].as<bool>();
+            args._soft_dirty = opts["soft-dirty"].as<bool>();
+
             args._type_bits |= opts["I8"].as<bool>() ? MatchTypeBitI8 : 0;
             args._type_bits |= opts["I16"].as<bool>() ? MatchTypeBitI16 : 0;
             args._type_bits |= opts["I32"].as<bool>() ? MatchTypeBitI32 : 0;
@@ -571,7 +619,7 @@ public:
             return;
         }
 
-        if (args._expr.empty()) {
+        if (args._expr.empty() and not args._unknown) {
             message() << "Usage: " << command << " [options] expression\n"
                       << _options;
             show();
@@ -590,7 +638,7 @@ public:
 
         try {
             auto view = scan(_app._message_view, _app._process, args);
-            if (not view or view->tui_count() == 0) {
+            if (not view or (view->tui_count() == 0 and not args._unknown)) {
                 message()
                     << SetColor(ColorInfo)
                     << "No matched result";
@@ -27,9 +27,12 @@ struct ScanArgs {
     size_t _step { 0 };
     uint32_t _type_bits { 0 };
     bool _c_string { false };
+    bool _unknown { false };
     bool _suspend_same_user { false };
     uint32_t _prot{kRegionFlagRead};
     bool _exclude_file{false};
+    bool _present_only { false };
+    bool _soft_dirty { false };
 };
 
 std::shared_ptr<SessionView> scan(
@@ -40,7 +40,7 @@ class ProcessSnapshot : public Process {
 
     VMRegion::ListType _regions {};
 
-    std::map<uintptr_t, size_t> _address_index {};
+    RegionIndex _address_index {};
 
     std::vector<std::vector<uint8_t>> _memory {};
 
@@ -48,11 +48,9 @@ public:
     ProcessSnapshot(pid_t pid, VMRegion::ListType&& regions, std::vector<std::vector<uint8_t>>&& memory)
         : _pid(pid)
         , _regions(regions)
+        , _address_index(_regions)
         , _memory(memory)
     {
-        for (size_t idx = 0; idx < regions.size(); ++idx) {
-            _address_index.emplace(regions.at(idx)._begin.get(), idx);
-        }
     }
 
     pid_t pid() const override { return _pid; }
@@ -159,30 +157,8 @@ public:
             }
             auto addr_end = addr + iovec_iter->iov_len;
 
-            auto pair = _address_index.lower_bound(addr);
-
-            assert(not _address_index.empty());
-
-            ssize_t idx = -1;
-
-            if (pair == _address_index.end()) {
-                idx = _regions.size() - 1;
-            } else {
-                idx = pair->second;
-            }
-
-            for (; idx >= 0; --idx) {
-                auto& region = _regions.at(idx);
-                if (addr >= region._begin.get() and addr_end <= region._end.get()) {
-                    break;
-                }
-
-                if (region._end.get() < addr) {
-                    return {};
-                }
-            }
-
-            if (idx < 0) {
+            auto idx = _address_index.find(addr, iovec_iter->iov_len);
+            if (idx == RegionIndex::npos) {
                 return {};
             }
 
@@ -246,6 +222,7 @@ public:
     {
         _options.add_options()("help", "show help message");
         _options.add_options()("load", po::bool_switch()->default_value(false), "load snapshot");
+        _options.add_options()("present-only", po::bool_switch()->default_value(false), "save anonymous pages that are not present or map the zero page as zeros");
         _options.add_options()("prefix", po::value<std::string>(), "prefix");
         _posiginal.add("prefix", 1);
     }
@@ -255,7 +232,7 @@ public:
         message() << "snapshot\t\tSave process's memory to file";
     }
 
-    void save_process(std::string prefix)
+    void save_process(std::string prefix, bool present_only)
     {
         if (prefix.empty()) {
             prefix = "dump";
@@ -298,6 +275,12 @@ public:
 
         in_buffer.resize(buffer_size);
 
+        std::vector<uint8_t> zero_buffer {};
+        std::vector<PageRange> ranges {};
+        if (present_only) {
+            zero_buffer.resize(buffer_size);
+        }
+
         size_t saved_offset = 0;
 
         for (auto& region : regions) {
@@ -310,27 +293,56 @@ public:
                 auto begin = region._begin;
                 auto end = region._end;
 
-                while (begin < end) {
-                    auto min_size = std::min(in_buffer.size(), end.get() - begin.get());
-                    auto read_size = _app._process->read(begin, in_buffer.data(), min_size);
+                ranges.clear();
+                if (not(present_only and _app._process->get_present_ranges(region, ranges))) {
+                    ranges.push_back(PageRange { region._begin, region._end });
+                }
+                // pages without data are saved as zeros instead of being read
+                ranges.push_back(PageRange { end, end });
 
-                    if (read_size == -1) {
-                        break;
+                auto write_or_report = [&](const void* ptr, size_t size) {
+                    if (fwrite(ptr, size, 1, memory_file) == 1) {
+                        return true;
                     }
-
-                    if (fwrite(in_buffer.data(), read_size, 1, memory_file) != 1) {
-                        message()
-                            << attributes::SetColor(attributes::ColorError)
-                            << "Out of disk space: " << std::hex
-                            << region._begin.get() << "-" << region._end.get()
-                            << " " << region._file;
-                        show();
-                        return;
+                    message()
+                        << attributes::SetColor(attributes::ColorError)
+                        << "Out of disk space: " << std::hex
+                        << region._begin.get() << "-" << region._end.get()
+                        << " " << region._file;
+                    show();
+                    return false;
+                };
+
+                for (auto& range : ranges) {
+                    while (begin < range._begin) {
+                        auto zero_size = std::min(zero_buffer.size(), range._begin.get() - begin.get());
+                        if (not write_or_report(zero_buffer.data(), zero_size)) {
+                            return;
+                        }
+                        saved_size += zero_size;
+                        begin = VMAddress { begin.get() + zero_size };
                     }
 
-                    saved_size += read_size;
+                    while (begin < range._end) {
+                        auto min_size = std::min(in_buffer.size(), range._end.get() - begin.get());
+                        auto read_size = _app._process->read(begin, in_buffer.data(), min_size);
 
-                    begin = VMAddress { begin.get() + read_size };
+                        if (read_size == -1) {
+                            break;
+                        }
+
+                        if (not write_or_report(in_buffer.data(), read_size)) {
+                            return;
+                        }
+
+                        saved_size += read_size;
+
+                        begin = VMAddress { begin.get() + read_size };
+                    }
+
+                    if (begin != range._end) {
+                        break;
+                    }
                 }
 
                 if (begin != end) {
@@ -457,6 +469,7 @@ public:
 
         std::string prefix {};
         bool load { false };
+        bool present_only { false };
 
         try {
             if (opts.count("prefix")) {
@@ -464,6 +477,7 @@ public:
             }
 
             load = opts["load"].as<bool>();
+            present_only = opts["present-only"].as<bool>();
 
         } catch (const std::exception& e) {
             message()
@@ -493,7 +507,7 @@ public:
                     show();
                     return;
                 }
-                save_process(prefix);
+                save_process(prefix, present_only);
             }
         } catch (const std::exception& e) {
             message()
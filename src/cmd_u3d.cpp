@@ -45,33 +45,62 @@ public:
         message() << "u3d\t\t\tFind unity3d object";
     }
 
-    bool read_u3d_class_name(VMAddress vmaddr, std::string& buffer, size_t max=64)
+    /*
+        Class names of the objects at candidates[0, count), names[idx] is
+        left empty when candidates[idx] is no object. Each pointer hop of
+        all candidates is one ReadBatch. Most candidates are no pointers,
+        the index rejects them without a syscall.
+    */
+    void read_u3d_class_names(const uintptr_t* candidates, size_t count, std::vector<std::string>& names, const RegionIndex& readable, ReadBatch& batch, size_t max = 64)
     {
-        uintptr_t class_ptr { 0 };
-        uintptr_t name_ptr { 0 };
-
-        if (_app._process->read(vmaddr, &class_ptr, sizeof(uintptr_t)) != sizeof(uintptr_t)) {
-            return false;
-        }
-
-        if (_app._process->read(VMAddress { class_ptr + 2 * sizeof(uintptr_t) }, &name_ptr, sizeof(uintptr_t)) != sizeof(uintptr_t)) {
-            return false;
-        }
+        std::vector<uintptr_t> class_ptrs(count);
+        std::vector<uintptr_t> name_ptrs(count);
+        std::vector<char> buffer(count * max);
+        std::vector<bool> alive(count, true);
+        std::vector<size_t> requests(count);
+
+        // reads `size` bytes at addresses[idx] + offset into values for the candidates still alive
+        auto hop = [&](const uintptr_t* addresses, size_t offset, void* values, size_t size) {
+            batch.clear();
+            for (size_t idx = 0; idx < count; ++idx) {
+                if (not alive[idx]) {
+                    continue;
+                }
+                auto addr = addresses[idx] + offset;
+                if (readable.find(addr, size) == RegionIndex::npos) {
+                    alive[idx] = false;
+                    continue;
+                }
+                requests[idx] = batch.add(VMAddress { addr }, reinterpret_cast<uint8_t*>(values) + idx * size, size);
+            }
+            batch.submit(*_app._process);
+            for (size_t idx = 0; idx < count; ++idx) {
+                if (alive[idx] and not batch.ok(requests[idx])) {
+                    alive[idx] = false;
+                }
+            }
+        };
 
-        buffer.resize(max);
-        if (_app._process->read(VMAddress { name_ptr }, buffer.data(), buffer.size()) != buffer.size()) {
-            return false;
-        }
+        hop(candidates, 0, class_ptrs.data(), sizeof(uintptr_t));
+        hop(class_ptrs.data(), 2 * sizeof(uintptr_t), name_ptrs.data(), sizeof(uintptr_t));
+        hop(name_ptrs.data(), 0, buffer.data(), max);
 
-        auto idx = buffer.find((char)0);
-        if (idx == std::string::npos or idx == 0) {
-            return false;
+        names.assign(count, std::string {});
+        for (size_t idx = 0; idx < count; ++idx) {
+            if (not alive[idx]) {
+                continue;
+            }
+            auto* name = buffer.data() + idx * max;
+            auto length = strnlen(name, max);
+            if (length != 0 and length != max) {
+                names[idx].assign(name, length);
+            }
         }
-        buffer.resize(idx);
-        return true;
     }
 
-    void find_u3d_object(VMAddress begin, VMAddress end, std::vector<std::pair<uintptr_t, std::string>>& results, const std::string& prefix) {
+    void find_u3d_object(VMAddress begin, VMAddress end, std::vector<std::pair<uintptr_t, std::string>>& results, const std::string& prefix, const RegionIndex& readable) {
+        constexpr size_t kBatchSize = 4096;
+
         std::vector<uintptr_t> memory{};
         memory.resize((end.get() - begin.get()) / sizeof(uintptr_t));
         if (_app._process->read(begin, memory.data(), end.get() - begin.get()) == -1) {
@@ -80,17 +109,23 @@ public:
 
         #pragma omp parallel
         {
-            std::string buffer{};
-            buffer.reserve(64);
+            ReadBatch batch{};
+            std::vector<std::string> names{};
 
             std::vector<std::pair<uintptr_t, std::string>> per_thread_results{};
 
             #pragma omp for nowait schedule(static)
-            for (auto addr : memory) {
-                if (read_u3d_class_name(VMAddress{addr}, buffer) and std::isalpha(buffer.at(0))
-                    and (prefix.empty() or memcmp(buffer.data(), prefix.c_str(), prefix.size()) == 0)
-                ) {
-                    per_thread_results.emplace_back(addr, buffer);
+            for (size_t first = 0; first < memory.size(); first += kBatchSize) {
+                auto count = std::min(kBatchSize, memory.size() - first);
+                read_u3d_class_names(memory.data() + first, count, names, readable, batch);
+
+                for (size_t idx = 0; idx < count; ++idx) {
+                    auto& name = names[idx];
+                    if (not name.empty() and std::isalpha(name.at(0))
+                        and (prefix.empty() or name.compare(0, prefix.size(), prefix) == 0)
+                    ) {
+                        per_thread_results.emplace_back(memory[first + idx], name);
+                    }
                 }
             }
 
@@ -125,6 +160,9 @@ public:
 
         std::vector<std::pair<uintptr_t, std::string>> results{};
 
+        auto regions = _app._process->get_memory_regions();
+        RegionIndex readable { regions, kRegionFlagRead };
+
         if (opts.count("begin") and opts.count("end")) {
             auto begin_ast = mathexpr::parse(opts["begin"].as<std::string>());
             auto begin_number_ast = dynamic_cast<mathexpr::ASTNumber*>(begin_ast.get());
@@ -148,13 +186,13 @@ public:
                 show();
                 return;
             }
-            find_u3d_object(VMAddress{begin_number_ast->_value}, VMAddress{end_number_ast->_value}, results, prefix);
+            find_u3d_object(VMAddress{begin_number_ast->_value}, VMAddress{end_number_ast->_value}, results, prefix, readable);
         } else {
-            for (auto& region : _app._process->get_memory_regions()) {
+            for (auto& region : regions) {
                 if ((region._prot & kRegionFlagWrite) == 0) {
                     continue;
                 }
-                find_u3d_object(region._begin, region._end, results, prefix);
+                find_u3d_object(region._begin, region._end, results, prefix, readable);
             }
         }
 
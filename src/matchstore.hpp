@@ -0,0 +1,502 @@
+/*
+Copyright (C) 2023 pom@vro.life
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef __matchstore_hpp__
+#define __matchstore_hpp__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matchvalue.hpp"
+
+namespace mypower {
+
+/*
+    Matches of one type, kept in chunks. A chunk stores the addresses as
+    32-bit offsets from its base and the values in a separate array, so a
+    MatchU8 takes 5 bytes instead of 16. Full chunks are never copied, a
+    new chunk is started instead.
+
+    When most positions of a full chunk match, the chunk is switched to the
+    dense form: one bit per position and a copy of the memory the positions
+    cover, which holds the values. Filters turn a chunk back to the sparse
+    form once it gets thin again.
+*/
+template <typename T>
+class MatchStore {
+public:
+    typedef T ValueType;
+    typedef typename GetMatchType<T>::type value_type;
+
+    static constexpr size_t kChunkCapacity = 64 * 1024;
+    static constexpr size_t kDensePositions = 1024 * 1024;
+
+    class Chunk {
+    public:
+        typedef T ValueType;
+
+    private:
+        uintptr_t _base;
+
+        // sparse
+        std::vector<uint32_t> _offsets {};
+        std::vector<T> _values {};
+
+        // dense, position N is at _base + N * _step
+        size_t _step { 0 };
+        size_t _count { 0 };
+        size_t _positions { 0 };
+        std::vector<uint64_t> _bitmap {};
+        std::vector<uint8_t> _bytes {};
+
+        size_t position(size_t index) const
+        {
+            for (size_t word = 0; word < _bitmap.size(); ++word) {
+                size_t bits = __builtin_popcountll(_bitmap[word]);
+                if (index < bits) {
+                    uint64_t mask = _bitmap[word];
+                    for (; index; --index) {
+                        mask &= mask - 1;
+                    }
+                    return word * 64 + __builtin_ctzll(mask);
+                }
+                index -= bits;
+            }
+            throw std::out_of_range("match index out of range");
+        }
+
+    public:
+        explicit Chunk(uintptr_t base)
+            : _base(base)
+        {
+        }
+
+        bool dense() const { return _step != 0; }
+
+        size_t size() const { return dense() ? _count : _offsets.size(); }
+
+        bool empty() const { return size() == 0; }
+
+        uintptr_t base() const { return _base; }
+
+        uintptr_t address(size_t index) const
+        {
+            return dense() ? _base + position(index) * _step : _base + _offsets[index];
+        }
+
+        // sparse only
+        T& value(size_t index) { return _values[index]; }
+
+        const T& value(size_t index) const { return _values[index]; }
+
+        value_type at(size_t index) const
+        {
+            if (dense()) {
+                return at_position(position(index));
+            }
+            return value_type { VMAddress { address(index) }, T { _values[index] } };
+        }
+
+        size_t step() const { return _step; }
+
+        // one past the last address a match may have
+        uintptr_t address_end() const
+        {
+            if (dense()) {
+                return _base + _positions * _step;
+            }
+            return _offsets.empty() ? _base : _base + _offsets.back() + 1;
+        }
+
+        std::vector<uint64_t>& bitmap() { return _bitmap; }
+
+        std::vector<uint8_t>& bytes() { return _bytes; }
+
+        void recount()
+        {
+            _count = 0;
+            for (auto word : _bitmap) {
+                _count += __builtin_popcountll(word);
+            }
+        }
+
+        value_type at_position(size_t position) const
+        {
+            T value {};
+            // only numbers have dense chunks
+            if constexpr (std::is_arithmetic<T>::value) {
+                memcpy(&value, _bytes.data() + position * _step, sizeof(T));
+            }
+            return value_type { VMAddress { _base + position * _step }, std::move(value) };
+        }
+
+        // index for sparse chunks, position for dense chunks
+        size_t cursor_begin() const { return dense() ? cursor_next(size_t(-1)) : 0; }
+
+        size_t cursor_end() const { return dense() ? _bitmap.size() * 64 : _offsets.size(); }
+
+        size_t cursor_next(size_t cursor) const
+        {
+            if (not dense()) {
+                return cursor + 1;
+            }
+            cursor += 1;
+            for (size_t word = cursor / 64; word < _bitmap.size(); ++word) {
+                uint64_t mask = _bitmap[word];
+                if (word == cursor / 64) {
+                    mask &= ~uint64_t(0) << (cursor % 64);
+                }
+                if (mask) {
+                    return word * 64 + __builtin_ctzll(mask);
+                }
+            }
+            return cursor_end();
+        }
+
+        value_type at_cursor(size_t cursor) const
+        {
+            return dense() ? at_position(cursor) : at(cursor);
+        }
+
+        bool accept(uintptr_t addr) const
+        {
+            if (dense()) {
+                if (addr < _base or (addr - _base) % _step != 0) {
+                    return false;
+                }
+                auto position = (addr - _base) / _step;
+                return position < kDensePositions and position >= _positions;
+            }
+            return size() < kChunkCapacity and addr >= _base and (addr - _base) <= UINT32_MAX;
+        }
+
+        void push_back(uintptr_t addr, T&& value)
+        {
+            if (dense()) {
+                auto position = (addr - _base) / _step;
+                _bitmap.resize(std::max(_bitmap.size(), position / 64 + 1));
+                _bytes.resize(std::max(_bytes.size(), position * _step + sizeof(T)));
+                _bitmap[position / 64] |= uint64_t(1) << (position % 64);
+                memcpy(_bytes.data() + position * _step, &value, sizeof(T));
+                _positions = position + 1;
+                _count += 1;
+                return;
+            }
+            _offsets.push_back(static_cast<uint32_t>(addr - _base));
+            _values.emplace_back(std::move(value));
+        }
+
+        // moves match `from` down to `to` while compacting
+        void move(size_t from, size_t to)
+        {
+            _offsets[to] = _offsets[from];
+            _values[to] = std::move(_values[from]);
+        }
+
+        void truncate(size_t size)
+        {
+            _offsets.erase(_offsets.begin() + size, _offsets.end());
+            _values.erase(_values.begin() + size, _values.end());
+            if (size * 2 < _offsets.capacity()) {
+                _offsets.shrink_to_fit();
+                _values.shrink_to_fit();
+            }
+        }
+
+        // drops the matches for which drop(address) is true, returns how many
+        template <typename Drop>
+        size_t erase_if(Drop&& drop)
+        {
+            size_t dropped = 0;
+            if (dense()) {
+                for (auto cursor = cursor_begin(); cursor != cursor_end(); cursor = cursor_next(cursor)) {
+                    if (drop(_base + cursor * _step)) {
+                        _bitmap[cursor / 64] &= ~(uint64_t(1) << (cursor % 64));
+                        dropped += 1;
+                    }
+                }
+                _count -= dropped;
+                to_sparse();
+                return dropped;
+            }
+
+            size_t keep = 0;
+            for (size_t index = 0; index < _offsets.size(); ++index) {
+                if (drop(_base + _offsets[index])) {
+                    continue;
+                }
+                if (keep != index) {
+                    move(index, keep);
+                }
+                keep += 1;
+            }
+            dropped = _offsets.size() - keep;
+            truncate(keep);
+            return dropped;
+        }
+
+        // a bit and `step` bytes per position against an offset and a value per match
+        bool prefer_dense(size_t step, size_t positions) const
+        {
+            return size() * (sizeof(uint32_t) + sizeof(T)) * 8 > positions * (step * 8 + 1);
+        }
+
+        // converts a sparse chunk of positions `step` bytes apart, returns false if it does not fit
+        bool to_dense(size_t step)
+        {
+            if constexpr (std::is_arithmetic<T>::value) {
+                if (dense() or empty() or step == 0) {
+                    return false;
+                }
+
+                auto positions = _offsets.back() / step + 1;
+                if (positions > kDensePositions or not prefer_dense(step, positions)) {
+                    return false;
+                }
+
+                for (auto offset : _offsets) {
+                    if (offset % step != 0) {
+                        return false;
+                    }
+                }
+
+                _step = step;
+                _count = 0;
+                _positions = 0;
+                for (size_t idx = 0; idx < _offsets.size(); ++idx) {
+                    push_back(_base + _offsets[idx], std::move(_values[idx]));
+                }
+                _offsets = {};
+                _values = {};
+                return true;
+            }
+            return false;
+        }
+
+        // converts a dense chunk back once it is cheaper to keep it sparse
+        void to_sparse()
+        {
+            if (not dense() or prefer_dense(_step, _positions)) {
+                return;
+            }
+
+            _offsets.reserve(_count);
+            _values.reserve(_count);
+            for (auto cursor = cursor_begin(); cursor != cursor_end(); cursor = cursor_next(cursor)) {
+                auto match = at_position(cursor);
+                _offsets.push_back(static_cast<uint32_t>(match._addr.get() - _base));
+                _values.emplace_back(std::move(match._value));
+            }
+            _step = 0;
+            _count = 0;
+            _positions = 0;
+            _bitmap = {};
+            _bytes = {};
+        }
+    };
+
+    class const_iterator {
+        const MatchStore* _store;
+        size_t _chunk;
+        size_t _cursor;
+
+        struct Arrow {
+            value_type _match;
+            const value_type* operator->() const { return &_match; }
+        };
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename MatchStore::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef value_type reference;
+
+        const_iterator(const MatchStore* store, size_t chunk)
+            : _store(store)
+            , _chunk(chunk)
+            , _cursor(chunk < store->_chunks.size() ? store->_chunks[chunk].cursor_begin() : 0)
+        {
+        }
+
+        value_type operator*() const { return _store->_chunks[_chunk].at_cursor(_cursor); }
+
+        Arrow operator->() const { return Arrow { **this }; }
+
+        const_iterator& operator++()
+        {
+            auto& chunk = _store->_chunks[_chunk];
+            _cursor = chunk.cursor_next(_cursor);
+            if (_cursor == chunk.cursor_end()) {
+                _chunk += 1;
+                _cursor = _chunk < _store->_chunks.size() ? _store->_chunks[_chunk].cursor_begin() : 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            auto iter = *this;
+            ++(*this);
+            return iter;
+        }
+
+        bool operator==(const const_iterator& other) const { return _chunk == other._chunk and _cursor == other._cursor; }
+
+        bool operator!=(const const_iterator& other) const { return not(*this == other); }
+    };
+
+private:
+    std::vector<Chunk> _chunks {};
+    // index of the first match of every chunk
+    std::vector<size_t> _first {};
+    size_t _size { 0 };
+    // distance of the scanned positions, 0 keeps every chunk sparse
+    size_t _step { 0 };
+
+public:
+    explicit MatchStore(size_t step = 0)
+        : _step(step)
+    {
+    }
+
+    size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    void clear()
+    {
+        _chunks.clear();
+        _first.clear();
+        _size = 0;
+    }
+
+    std::vector<Chunk>& chunks() { return _chunks; }
+
+    const std::vector<Chunk>& chunks() const { return _chunks; }
+
+    void push_back(uintptr_t addr, T&& value)
+    {
+        if (not _chunks.empty() and not _chunks.back().accept(addr)) {
+            _chunks.back().to_dense(_step);
+        }
+
+        if (_chunks.empty() or not _chunks.back().accept(addr)) {
+            _chunks.emplace_back(addr);
+            _first.push_back(_size);
+        }
+        _chunks.back().push_back(addr, std::move(value));
+        _size += 1;
+    }
+
+    void push_back(value_type&& match)
+    {
+        push_back(match._addr.get(), std::move(match._value));
+    }
+
+    // moves the chunks of other to the end of this store
+    void append(MatchStore&& other)
+    {
+        if (not other._chunks.empty()) {
+            other._chunks.back().to_dense(other._step);
+        }
+
+        for (auto& chunk : other._chunks) {
+            if (chunk.empty()) {
+                continue;
+            }
+            _first.push_back(_size);
+            _size += chunk.size();
+            _chunks.emplace_back(std::move(chunk));
+        }
+        other.clear();
+    }
+
+    /*
+        Drops the matches whose `size` bytes overlap one of the sorted
+        ranges. Chunks clear of the ranges are not touched. Returns the
+        number of matches dropped.
+    */
+    template <typename Ranges>
+    size_t erase(const Ranges& ranges, size_t size)
+    {
+        size_t dropped = 0;
+        auto range = ranges.begin();
+
+        for (auto& chunk : _chunks) {
+            auto chunk_begin = chunk.base();
+            auto chunk_end = chunk.address_end() + size - 1;
+
+            while (range != ranges.end() and range->_end.get() <= chunk_begin) {
+                ++range;
+            }
+            if (range == ranges.end()) {
+                break;
+            }
+            if (range->_begin.get() >= chunk_end) {
+                continue;
+            }
+
+            auto hole = range;
+            dropped += chunk.erase_if([&](uintptr_t addr) {
+                while (hole != ranges.end() and hole->_end.get() <= addr) {
+                    ++hole;
+                }
+                return hole != ranges.end() and hole->_begin.get() < addr + size;
+            });
+        }
+
+        if (dropped) {
+            reindex();
+        }
+        return dropped;
+    }
+
+    // call after the chunks were compacted
+    void reindex()
+    {
+        _chunks.erase(std::remove_if(_chunks.begin(), _chunks.end(), [](const Chunk& chunk) { return chunk.empty(); }), _chunks.end());
+
+        _first.clear();
+        _size = 0;
+        for (auto& chunk : _chunks) {
+            _first.push_back(_size);
+            _size += chunk.size();
+        }
+    }
+
+    value_type at(size_t index) const
+    {
+        if (index >= _size) {
+            throw std::out_of_range("match index out of range");
+        }
+        auto chunk = std::upper_bound(_first.begin(), _first.end(), index) - _first.begin() - 1;
+        return _chunks[chunk].at(index - _first[chunk]);
+    }
+
+    const_iterator begin() const { return const_iterator { this, 0 }; }
+
+    const_iterator end() const { return const_iterator { this, _chunks.size() }; }
+};
+
+} // namespace mypower
+
+#endif
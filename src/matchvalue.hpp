@@ -141,57 +141,57 @@ struct AccessMatch {
 
 template <typename T>
 class AccessMatchNumber : public AccessMatch {
-    const T* _ptr;
+    T _match;
 
 public:
-    AccessMatchNumber(const T* ptr)
-        : _ptr { ptr }
+    AccessMatchNumber(const T& match)
+        : _match { match }
     {
     }
 
     VMAddress address() override
     {
-        return _ptr->_addr;
+        return _match._addr;
     }
 
     void value(std::ostringstream& oss) override
     {
-        oss << _ptr->_value;
+        oss << _match._value;
     }
 
     std::string type() override
     {
-        return type_to_string(_ptr->_value);
+        return type_to_string(_match._value);
     }
 
     void type(std::ostringstream& oss) override
     {
-        oss << type_to_string(_ptr->_value);
+        oss << type_to_string(_match._value);
     }
 };
 
 template <typename T>
 class AccessMatchBytes : public AccessMatch {
-    const T* _ptr;
+    T _match;
 
 public:
-    AccessMatchBytes(const T* ptr)
-        : _ptr { ptr }
+    AccessMatchBytes(const T& match)
+        : _match { match }
     {
     }
 
     VMAddress address() override
     {
-        return _ptr->_addr;
+        return _match._addr;
     }
 
     void value(std::ostringstream& oss) override
     {
-        for (auto ch : _ptr->_value) {
+        for (auto ch : _match._value) {
             oss << std::setw(2) << std::setfill('0') << std::hex << (int)ch << " ";
         }
         oss << "| ";
-        for (auto ch : _ptr->_value) {
+        for (auto ch : _match._value) {
             if (ch >= 32 and ch <= 126) {
                 oss << ch;
             } else {
@@ -202,28 +202,28 @@ public:
 
     std::string type() override
     {
-        return type_to_string(_ptr->_value);
+        return type_to_string(_match._value);
     }
 
     void type(std::ostringstream& oss) override
     {
-        oss << type_to_string(_ptr->_value);
+        oss << type_to_string(_match._value);
     }
 };
 
 template <typename T>
 class AccessMatchUnknown : public AccessMatch {
-    const T* _ptr;
+    T _match;
 
 public:
-    AccessMatchUnknown(const T* ptr)
-        : _ptr { ptr }
+    AccessMatchUnknown(const T& match)
+        : _match { match }
     {
     }
 
     VMAddress address() override
     {
-        return _ptr->_addr;
+        return _match._addr;
     }
 
     void value(std::ostringstream& oss) override
@@ -233,12 +233,12 @@ public:
 
     std::string type() override
     {
-        return type_to_string(_ptr->_value);
+        return type_to_string(_match._value);
     }
 
     void type(std::ostringstream& oss) override
     {
-        oss << type_to_string(_ptr->_value);
+        oss << type_to_string(_match._value);
     }
 };
 
@@ -251,12 +251,12 @@ inline
         type
         access_match(const T& match)
 {
-    return std::unique_ptr<AccessMatch> { new AccessMatchNumber<T>(&match) };
+    return std::unique_ptr<AccessMatch> { new AccessMatchNumber<T>(match) };
 }
 
 inline std::unique_ptr<AccessMatch> access_match(const MatchBYTES& match)
 {
-    return std::unique_ptr<AccessMatch> { new AccessMatchBytes<MatchBYTES>(&match) };
+    return std::unique_ptr<AccessMatch> { new AccessMatchBytes<MatchBYTES>(match) };
 }
 
 } // namespace mypower
@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2023 pom@vro.life
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+#include <string>
+
+#include <zstd.h>
+
+#include "pagesnapshot.hpp"
+
+using namespace std::string_literals;
+
+namespace mypower {
+
+// fast and still good on mostly zero heap pages
+static constexpr int kCompressionLevel = 1;
+
+SnapshotBlock::SnapshotBlock(VMAddress begin, VMAddress limit, const void* data, size_t size)
+    : _begin(begin)
+    , _limit(limit)
+    , _size(size)
+{
+    _data.resize(ZSTD_compressBound(size));
+    auto compressed = ZSTD_compress(_data.data(), _data.size(), data, size, kCompressionLevel);
+    if (ZSTD_isError(compressed)) {
+        throw std::runtime_error("Compress snapshot failed: "s + ZSTD_getErrorName(compressed));
+    }
+    _data.resize(compressed);
+    _data.shrink_to_fit();
+}
+
+void SnapshotBlock::decompress(void* data) const
+{
+    auto size = ZSTD_decompress(data, _size, _data.data(), _data.size());
+    if (ZSTD_isError(size) or size != _size) {
+        throw std::runtime_error("Decompress snapshot failed");
+    }
+}
+
+} // namespace mypower
@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2023 pom@vro.life
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef __pagesnapshot_hpp__
+#define __pagesnapshot_hpp__
+
+#include <cstdint>
+#include <vector>
+
+#include "vmmap.hpp"
+
+namespace mypower {
+
+/*
+    A zstd compressed copy of [_begin, _begin + _size)
+*/
+class SnapshotBlock {
+    VMAddress _begin { 0 };
+    // positions past _limit belong to the next block
+    VMAddress _limit { 0 };
+    size_t _size { 0 };
+    std::vector<uint8_t> _data {};
+
+public:
+    SnapshotBlock() = default;
+
+    SnapshotBlock(VMAddress begin, VMAddress limit, const void* data, size_t size);
+
+    VMAddress begin() const { return _begin; }
+
+    VMAddress limit() const { return _limit; }
+
+    size_t size() const { return _size; }
+
+    size_t compressed_size() const { return _data.size(); }
+
+    bool empty() const { return _size == 0; }
+
+    // data must have room for size() bytes
+    void decompress(void* data) const;
+};
+
+/*
+    The memory recorded by an unknown value scan. The first filter compares
+    the live memory against it and creates the matches.
+*/
+struct PageSnapshot {
+    uint32_t _type_bits { 0 };
+    size_t _step { 0 };
+    std::vector<SnapshotBlock> _blocks {};
+
+    bool empty() const { return _blocks.empty(); }
+
+    void clear()
+    {
+        _type_bits = 0;
+        _step = 0;
+        _blocks.clear();
+    }
+
+    size_t size() const
+    {
+        size_t size = 0;
+        for (auto& block : _blocks) {
+            size += block.size();
+        }
+        return size;
+    }
+
+    size_t compressed_size() const
+    {
+        size_t size = 0;
+        for (auto& block : _blocks) {
+            size += block.compressed_size();
+        }
+        return size;
+    }
+};
+
+} // namespace mypower
+
+#endif
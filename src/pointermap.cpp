@@ -0,0 +1,357 @@
+/*
+Copyright (C) 2023 pom@vro.life
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "pointermap.hpp"
+
+namespace fs = std::filesystem;
+
+namespace mypower {
+
+/*
+    File layout: the header, the entries as they are in memory, the
+    regions, the targets, then the names of the regions. The entries start at a
+    multiple of their alignment, so a mapped file is used in place.
+*/
+static constexpr char kFileMagic[8] = { 'M', 'Y', 'P', 'T', 'R', 'M', 'A', 'P' };
+static constexpr uint32_t kFileVersion = 2;
+
+struct FileHeader {
+    char _magic[8];
+    uint32_t _version;
+    uint32_t _pointer_size;
+    uint64_t _entries;
+    uint64_t _regions;
+    uint64_t _names;
+    uint64_t _targets;
+    uint64_t _begin;
+    uint64_t _end;
+};
+
+struct FileRegion {
+    uint64_t _begin;
+    uint64_t _end;
+    uint64_t _offset;
+    uint32_t _prot;
+    uint32_t _flags;
+    // the file name, then the description, in the names
+    uint64_t _name;
+    uint32_t _file_size;
+    uint32_t _desc_size;
+};
+
+static_assert(sizeof(FileHeader) % alignof(PointerMap::Entry) == 0);
+
+enum FileRegionFlag {
+    kFileRegionShared = 1,
+    kFileRegionAndroidBss = 2,
+};
+
+void PointerMap::save(const fs::path& path, const std::vector<uintptr_t>& targets, uintptr_t begin, uintptr_t end) const
+{
+    std::string names {};
+    std::vector<FileRegion> regions {};
+    regions.reserve(_regions.size());
+    for (auto& region : _regions) {
+        FileRegion item {};
+        item._begin = region._begin.get();
+        item._end = region._end.get();
+        item._offset = region._offset;
+        item._prot = region._prot;
+        item._flags = (region._shared ? kFileRegionShared : 0) | (region._android_bss ? kFileRegionAndroidBss : 0);
+        item._name = names.size();
+        item._file_size = region._file.size();
+        item._desc_size = region._desc.size();
+        names.append(region._file);
+        names.append(region._desc);
+        regions.push_back(item);
+    }
+
+    FileHeader header {};
+    memcpy(header._magic, kFileMagic, sizeof(kFileMagic));
+    header._version = kFileVersion;
+    header._pointer_size = sizeof(uintptr_t);
+    header._entries = _size;
+    header._regions = regions.size();
+    header._names = names.size();
+    header._targets = targets.size();
+    header._begin = begin;
+    header._end = end;
+
+    std::ofstream file { path, std::ios::binary | std::ios::trunc };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(_data), _size * sizeof(Entry));
+    file.write(reinterpret_cast<const char*>(regions.data()), regions.size() * sizeof(FileRegion));
+    for (uint64_t target : targets) {
+        file.write(reinterpret_cast<const char*>(&target), sizeof(target));
+    }
+    file.write(names.data(), names.size());
+    file.close();
+
+    if (not file) {
+        throw std::runtime_error("unable to write " + path.string() + ": " + strerror(errno));
+    }
+}
+
+void PointerMap::load(const fs::path& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("unable to open " + path.string() + ": " + strerror(errno));
+    }
+
+    struct stat buf {
+        0
+    };
+    if (fstat(fd, &buf) != 0 or static_cast<size_t>(buf.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("not a pointer map: " + path.string());
+    }
+
+    size_t length = buf.st_size;
+    void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        throw std::runtime_error("unable to map " + path.string() + ": " + strerror(errno));
+    }
+    std::shared_ptr<const void> mapping { ptr, [length](const void* ptr) { munmap(const_cast<void*>(ptr), length); } };
+
+    auto* bytes = reinterpret_cast<const char*>(ptr);
+    FileHeader header {};
+    memcpy(&header, bytes, sizeof(header));
+
+    if (memcmp(header._magic, kFileMagic, sizeof(kFileMagic)) != 0 or header._version != kFileVersion) {
+        throw std::runtime_error("not a pointer map: " + path.string());
+    }
+    if (header._pointer_size != sizeof(uintptr_t)) {
+        throw std::runtime_error("pointer map of another pointer size: " + path.string());
+    }
+
+    // every count is checked against the file before it is multiplied
+    size_t offset = sizeof(FileHeader);
+    if (header._entries > (length - offset) / sizeof(Entry)) {
+        throw std::runtime_error("truncated pointer map: " + path.string());
+    }
+    auto* entries = reinterpret_cast<const Entry*>(bytes + offset);
+    offset += header._entries * sizeof(Entry);
+
+    if (header._regions > (length - offset) / sizeof(FileRegion)) {
+        throw std::runtime_error("truncated pointer map: " + path.string());
+    }
+    auto* file_regions = bytes + offset;
+    offset += header._regions * sizeof(FileRegion);
+
+    if (header._targets > (length - offset) / sizeof(uint64_t)) {
+        throw std::runtime_error("truncated pointer map: " + path.string());
+    }
+    std::vector<uintptr_t> targets(header._targets);
+    for (size_t idx = 0; idx < targets.size(); ++idx) {
+        uint64_t target = 0;
+        memcpy(&target, bytes + offset + idx * sizeof(target), sizeof(target));
+        targets[idx] = target;
+    }
+    offset += header._targets * sizeof(uint64_t);
+
+    if (header._names > length - offset) {
+        throw std::runtime_error("truncated pointer map: " + path.string());
+    }
+    auto* names = bytes + offset;
+
+    VMRegion::ListType regions {};
+    regions.reserve(header._regions);
+    for (size_t idx = 0; idx < header._regions; ++idx) {
+        FileRegion item {};
+        memcpy(&item, file_regions + idx * sizeof(FileRegion), sizeof(item));
+        if (item._name > header._names or uint64_t(item._file_size) + item._desc_size > header._names - item._name) {
+            throw std::runtime_error("truncated pointer map: " + path.string());
+        }
+
+        VMRegion region {};
+        region._begin = VMAddress { item._begin };
+        region._end = VMAddress { item._end };
+        region._offset = item._offset;
+        region._prot = item._prot;
+        region._shared = item._flags & kFileRegionShared;
+        region._android_bss = item._flags & kFileRegionAndroidBss;
+        region._file.assign(names + item._name, item._file_size);
+        region._desc.assign(names + item._name + item._file_size, item._desc_size);
+        regions.push_back(std::move(region));
+    }
+
+    _entries.clear();
+    _mapping = std::move(mapping);
+    _data = entries;
+    _size = header._entries;
+    _regions = std::move(regions);
+    _region_index = RegionIndex { _regions };
+    _targets = std::move(targets);
+    _begin = header._begin;
+    _end = header._end;
+}
+
+std::vector<uintptr_t> PointerMap::values(const std::vector<uintptr_t>& addrs) const
+{
+    std::vector<uintptr_t> values(addrs.size(), 0);
+    if (addrs.empty()) {
+        return values;
+    }
+
+    // an address holds one pointer, no two entries write the same value
+#pragma omp parallel for schedule(static)
+    for (size_t idx = 0; idx < _size; ++idx) {
+        auto& entry = _data[idx];
+        auto iter = std::lower_bound(addrs.begin(), addrs.end(), entry._addr);
+        if (iter != addrs.end() and *iter == entry._addr) {
+            values[iter - addrs.begin()] = entry._value;
+        }
+    }
+    return values;
+}
+
+std::vector<uintptr_t> PointerMap::follow(const std::vector<uintptr_t>& bases, const std::vector<const PointerChain*>& chains) const
+{
+    std::vector<uintptr_t> addrs { bases };
+    std::vector<uintptr_t> reads {};
+
+    size_t depth_max = 0;
+    for (auto* chain : chains) {
+        depth_max = std::max(depth_max, chain->depth());
+    }
+
+    for (size_t level = 0; level < depth_max; ++level) {
+        reads.clear();
+        for (size_t idx = 0; idx < chains.size(); ++idx) {
+            if (addrs[idx] != 0 and level < chains[idx]->depth()) {
+                reads.push_back(addrs[idx]);
+            }
+        }
+        std::sort(reads.begin(), reads.end());
+        reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+
+        auto values = this->values(reads);
+
+        for (size_t idx = 0; idx < chains.size(); ++idx) {
+            if (addrs[idx] == 0 or level >= chains[idx]->depth()) {
+                continue;
+            }
+            auto value = values[std::lower_bound(reads.begin(), reads.end(), addrs[idx]) - reads.begin()];
+            addrs[idx] = value == 0 ? 0 : value + chains[idx]->_offsets[level];
+        }
+    }
+    return addrs;
+}
+
+std::vector<uintptr_t> resolve_chains(Process& process, const std::vector<const PointerChain*>& chains)
+{
+    std::vector<uintptr_t> addrs(chains.size());
+    std::vector<uintptr_t> values(chains.size());
+    std::vector<size_t> requests(chains.size());
+    ReadBatch batch {};
+
+    size_t depth_max = 0;
+    for (size_t idx = 0; idx < chains.size(); ++idx) {
+        addrs[idx] = chains[idx]->base();
+        depth_max = std::max(depth_max, chains[idx]->depth());
+    }
+
+    for (size_t level = 0; level < depth_max; ++level) {
+        batch.clear();
+        for (size_t idx = 0; idx < chains.size(); ++idx) {
+            if (addrs[idx] != 0 and level < chains[idx]->depth()) {
+                requests[idx] = batch.add(VMAddress { addrs[idx] }, &values[idx], sizeof(uintptr_t));
+            }
+        }
+        if (batch.empty()) {
+            break;
+        }
+
+        batch.submit(process);
+
+        for (size_t idx = 0; idx < chains.size(); ++idx) {
+            if (addrs[idx] == 0 or level >= chains[idx]->depth()) {
+                continue;
+            }
+            auto value = batch.ok(requests[idx]) ? values[idx] : 0;
+            addrs[idx] = value == 0 ? 0 : value + chains[idx]->_offsets[level];
+        }
+    }
+    return addrs;
+}
+
+// the region a module is based on: the first mapping of the file, or the first region of the name
+static const VMRegion* module_region(const VMRegion::ListType& regions, const std::string& module)
+{
+    for (auto& region : regions) {
+        if (not region._android_bss and region._file == module) {
+            return &region;
+        }
+    }
+    for (auto& region : regions) {
+        if (region._file.empty() and region._desc == module) {
+            return &region;
+        }
+    }
+    return nullptr;
+}
+
+bool PointerMap::module_offset(uintptr_t addr, std::string& module, uintptr_t& offset) const
+{
+    auto index = _region_index.find(addr);
+    if (index == RegionIndex::npos) {
+        return false;
+    }
+
+    // .bss and other anonymous memory behind a file mapping
+    auto owner = index;
+    while (owner > 0 and (_regions[owner]._android_bss or (_regions[owner]._file.empty() and _regions[owner]._desc.empty()))
+        and _regions[owner - 1]._end == _regions[owner]._begin) {
+        --owner;
+    }
+
+    auto& region = _regions[owner];
+    if (not region._file.empty() and not region._android_bss) {
+        module = region._file;
+    } else if (not _regions[index]._desc.empty() and _regions[index]._file.empty()) {
+        module = _regions[index]._desc;
+    } else {
+        return false;
+    }
+
+    auto* base = module_region(_regions, module);
+    offset = addr - (base->_begin.get() - (base->_file.empty() ? 0 : base->_offset));
+    return true;
+}
+
+bool PointerMap::module_address(const std::string& module, uintptr_t offset, uintptr_t& addr) const
+{
+    auto* base = module_region(_regions, module);
+    if (base == nullptr) {
+        return false;
+    }
+    addr = base->_begin.get() - (base->_file.empty() ? 0 : base->_offset) + offset;
+    return true;
+}
+
+} // namespace mypower
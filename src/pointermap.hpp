@@ -0,0 +1,418 @@
+/*
+Copyright (C) 2023 pom@vro.life
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef __pointermap_hpp__
+#define __pointermap_hpp__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "macros.hpp"
+#include "scanner.hpp"
+
+namespace mypower {
+
+/*
+    A pointer chain from a static address to the target: read the pointer
+    at _pointers[0], add _offsets[0] to get _pointers[1], and so on. The
+    last value plus the last offset is the target.
+*/
+struct PointerChain {
+    std::vector<uintptr_t> _pointers {};
+    std::vector<uintptr_t> _offsets {};
+    uintptr_t _target { 0 };
+
+    uintptr_t base() const { return _pointers.front(); }
+
+    size_t depth() const { return _pointers.size(); }
+};
+
+/*
+    Where the chains end in the process now, 0 for a chain with a read
+    failed or a null pointer. The reads of one level of all chains are one
+    ReadBatch.
+*/
+std::vector<uintptr_t> resolve_chains(Process& process, const std::vector<const PointerChain*>& chains);
+
+/*
+    Reverse pointer index: every pointer-sized value of the scanned memory
+    that points into a mapped region, sorted by value. It is built with one
+    pass over the memory, after that "who points into [low, high]" is a
+    range of the index instead of a scan.
+
+    A map can be saved with the search it was built for, and loaded with
+    mmap later. The entries of a loaded map stay in the file.
+*/
+class PointerMap {
+public:
+    struct Entry {
+        // where the pointer points to
+        uintptr_t _value;
+        // where the pointer is stored
+        uintptr_t _addr;
+    };
+
+    typedef std::pair<const Entry*, const Entry*> RangeType;
+
+private:
+    std::vector<Entry> _entries {};
+    // the file of a loaded map
+    std::shared_ptr<const void> _mapping {};
+    const Entry* _data { nullptr };
+    size_t _size { 0 };
+
+    VMRegion::ListType _regions {};
+    RegionIndex _region_index {};
+
+    // the search saved with the map
+    std::vector<uintptr_t> _targets {};
+    uintptr_t _begin { 0 };
+    uintptr_t _end { 0 };
+
+public:
+    PointerMap() = default;
+    PointerMap(PointerMap&&) noexcept = default;
+    PointerMap& operator=(PointerMap&&) noexcept = default;
+    // _data points into _entries
+    MYPOWER_NO_COPY(PointerMap);
+
+    /*
+        Reads the `prot` regions of the process for pointers into any of its
+        regions. Pointers are looked for at every `step` bytes.
+    */
+    void build(std::shared_ptr<Process>& process, size_t step, uint32_t prot = kRegionFlagReadWrite)
+    {
+        Session session { process };
+        session.update_memory_region();
+
+        RegionIndex targets { session.memory_regions() };
+        session.scan(ScanPointer { targets, step }, prot);
+
+        _regions = session.memory_regions();
+        _region_index = RegionIndex { _regions };
+        _mapping.reset();
+        auto& matches = session.get<uintptr_t>();
+        _entries.clear();
+        _entries.reserve(matches.size());
+        for (auto iter = matches.begin(); iter != matches.end(); ++iter) {
+            auto match = *iter;
+            _entries.push_back(Entry { match._value, match._addr.get() });
+        }
+        // the matches are not needed for sorting
+        session.reset();
+
+        std::sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) {
+            return a._value < b._value or (a._value == b._value and a._addr < b._addr);
+        });
+        _data = _entries.data();
+        _size = _entries.size();
+    }
+
+    // throws std::runtime_error
+    void save(const std::filesystem::path& path, const std::vector<uintptr_t>& targets, uintptr_t begin, uintptr_t end) const;
+
+    // throws std::runtime_error, a file of another pointer size is refused
+    void load(const std::filesystem::path& path);
+
+    size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    // regions of the process when the map was built
+    const VMRegion::ListType& regions() const { return _regions; }
+
+    const std::vector<uintptr_t>& targets() const { return _targets; }
+
+    uintptr_t begin() const { return _begin; }
+
+    uintptr_t end() const { return _end; }
+
+    // pointers with a value in [low, high], sorted by value
+    RangeType range(uintptr_t low, uintptr_t high) const
+    {
+        auto first = std::lower_bound(_data, _data + _size, low,
+            [](const Entry& entry, uintptr_t value) { return entry._value < value; });
+        auto last = std::upper_bound(first, _data + _size, high,
+            [](uintptr_t value, const Entry& entry) { return value < entry._value; });
+        return { first, last };
+    }
+
+    // pointers to [target - offset_max, target], the structs that may hold target
+    RangeType referrers(uintptr_t target, size_t offset_max) const
+    {
+        return range(target - std::min<uintptr_t>(target, offset_max), target);
+    }
+
+    /*
+        Values of the pointers at the sorted, unique `addrs`, 0 where no
+        pointer is stored. One pass over the map, it is not sorted by
+        address.
+    */
+    std::vector<uintptr_t> values(const std::vector<uintptr_t>& addrs) const;
+
+    /*
+        Where the chains end in this map when they start at `bases`
+        instead, 0 for a chain with a pointer missing. Each level of all
+        chains is one pass over the map.
+    */
+    std::vector<uintptr_t> follow(const std::vector<uintptr_t>& bases, const std::vector<const PointerChain*>& chains) const;
+
+    /*
+        Addresses relative to the module they belong to, so they survive
+        address space layout randomization. The module of a file mapping is
+        the file, anonymous memory right behind a file mapping (.bss) belongs
+        to that file, and other named regions like [heap] stand alone.
+    */
+    bool module_offset(uintptr_t addr, std::string& module, uintptr_t& offset) const;
+    bool module_address(const std::string& module, uintptr_t offset, uintptr_t& addr) const;
+};
+
+/*
+    Breadth-first search of the pointer map for the chains from
+    [_begin, _end) to a target. Level n holds the addresses n pointers away
+    from the target, so the chains come out shortest first. The nodes of a
+    level are expanded by all threads, and an address that an earlier
+    node already reached is not expanded again.
+*/
+class PointerSearch {
+public:
+    struct Config {
+        uintptr_t _begin { 0 };
+        uintptr_t _end { 0 };
+        size_t _depth_max { 5 };
+        size_t _offset_max { 1024 };
+        // addresses with more pointers to them are not expanded
+        size_t _fanout_max { 1024 };
+        // nodes held by the search, 32 bytes each
+        size_t _node_max { size_t(1) << 24 };
+        // zero for no limit
+        std::chrono::milliseconds _time_max { 0 };
+        // otherwise a target is done after the first level with chains to it
+        bool _find_all { false };
+    };
+
+    enum class Status {
+        Done,
+        NodeLimit,
+        TimeLimit,
+    };
+
+private:
+    // nodes per parallel work item
+    static constexpr size_t kBlockSize = 256;
+    static constexpr size_t npos = size_t(-1);
+
+    struct Node {
+        // where the pointer is stored
+        uintptr_t _addr;
+        // where it points to
+        uintptr_t _value;
+        // index in the level before, npos for a target
+        size_t _prev;
+        // index in _targets
+        size_t _target;
+    };
+
+    typedef std::pair<uintptr_t, size_t> VisitedType;
+
+    const PointerMap& _map;
+    Config _config;
+    // sorted, unique
+    std::vector<uintptr_t> _targets {};
+    // targets with chains found, when not _find_all
+    std::vector<bool> _done {};
+    std::vector<std::vector<Node>> _levels {};
+    // address and target of all nodes, sorted
+    std::vector<VisitedType> _visited {};
+    // the last level starts with the ends of chains, they are not expanded
+    size_t _chains { 0 };
+
+    PointerChain chain(size_t level, size_t index) const
+    {
+        PointerChain chain {};
+        for (; level > 0; --level) {
+            auto& node = _levels[level][index];
+            auto& next = _levels[level - 1][node._prev];
+            chain._pointers.push_back(node._addr);
+            chain._offsets.push_back(next._addr - node._value);
+            index = node._prev;
+        }
+        chain._target = _levels[0][index]._addr;
+        return chain;
+    }
+
+    bool visited(const Node& node) const
+    {
+        return std::binary_search(_visited.begin(), _visited.end(), VisitedType { node._addr, node._target });
+    }
+
+    /*
+        The nodes pointing to the last level, duplicates and visited
+        addresses of the same target dropped. The level is sorted by
+        address, the targets sharing an address share its lookup.
+    */
+    std::vector<Node> expand(std::atomic<Status>& status, std::chrono::steady_clock::time_point deadline)
+    {
+        auto& frontier = _levels.back();
+        auto blocks = (frontier.size() - _chains + kBlockSize - 1) / kBlockSize;
+        std::vector<std::vector<Node>> buffers(blocks);
+        std::atomic<size_t> nodes { _visited.size() };
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t block = 0; block < blocks; ++block) {
+            auto begin = _chains + block * kBlockSize;
+            auto end = std::min(frontier.size(), begin + kBlockSize);
+            PointerMap::RangeType range { nullptr, nullptr };
+            uintptr_t range_addr = 0;
+
+            for (size_t idx = begin; idx < end; ++idx) {
+                if (status.load(std::memory_order_relaxed) != Status::Done) {
+                    break;
+                }
+                if (_config._time_max.count() != 0 and std::chrono::steady_clock::now() > deadline) {
+                    status = Status::TimeLimit;
+                    break;
+                }
+
+                auto& node = frontier[idx];
+                if (_done[node._target]) {
+                    continue;
+                }
+                if (idx == begin or node._addr != range_addr) {
+                    range = _map.referrers(node._addr, _config._offset_max);
+                    range_addr = node._addr;
+                }
+
+                auto [first, last] = range;
+                auto count = static_cast<size_t>(last - first);
+                if (count > _config._fanout_max) {
+                    continue;
+                }
+                if (nodes.fetch_add(count) + count > _config._node_max) {
+                    status = Status::NodeLimit;
+                    break;
+                }
+                for (auto iter = first; iter != last; ++iter) {
+                    buffers[block].push_back(Node { iter->_addr, iter->_value, idx, node._target });
+                }
+            }
+        }
+
+        std::vector<Node> level {};
+        size_t size = 0;
+        for (auto& buffer : buffers) {
+            size += buffer.size();
+        }
+        level.reserve(size);
+        for (auto& buffer : buffers) {
+            level.insert(level.end(), buffer.begin(), buffer.end());
+        }
+
+        // the first parent of an address is kept, so the result does not depend on the threads
+        std::stable_sort(level.begin(), level.end(), [](const Node& a, const Node& b) {
+            return a._addr < b._addr or (a._addr == b._addr and a._target < b._target);
+        });
+        level.erase(std::unique(level.begin(), level.end(), [](const Node& a, const Node& b) {
+            return a._addr == b._addr and a._target == b._target;
+        }),
+            level.end());
+        level.erase(std::remove_if(level.begin(), level.end(), [&](const Node& node) { return visited(node); }), level.end());
+        return level;
+    }
+
+public:
+    PointerSearch(const PointerMap& map, const Config& config)
+        : _map(map)
+        , _config(config)
+    {
+    }
+
+    /*
+        Searches for the chains to all targets at once: the memory was read
+        once for the map, and the levels are shared, so the cost follows the
+        number of nodes rather than the number of targets.
+
+        Calls callback(const PointerChain&) for every chain found, level by
+        level and by base address within a level. A chain ends at its first
+        pointer in [_begin, _end), such a pointer is not expanded further.
+    */
+    template <typename Callback>
+    Status run(const std::vector<uintptr_t>& targets, Callback&& callback)
+    {
+        auto deadline = std::chrono::steady_clock::now() + _config._time_max;
+        std::atomic<Status> status { Status::Done };
+
+        _targets = targets;
+        std::sort(_targets.begin(), _targets.end());
+        _targets.erase(std::unique(_targets.begin(), _targets.end()), _targets.end());
+        _done.assign(_targets.size(), false);
+
+        _levels.clear();
+        _levels.emplace_back();
+        _visited.clear();
+        for (size_t idx = 0; idx < _targets.size(); ++idx) {
+            _levels.back().push_back(Node { _targets[idx], 0, npos, idx });
+            _visited.push_back(VisitedType { _targets[idx], idx });
+        }
+
+        _chains = 0;
+
+        for (size_t depth = 1; depth <= _config._depth_max and _levels.back().size() > _chains; ++depth) {
+            auto level = expand(status, deadline);
+
+            auto middle = _visited.size();
+            for (auto& node : level) {
+                _visited.push_back(VisitedType { node._addr, node._target });
+            }
+            std::inplace_merge(_visited.begin(), _visited.begin() + middle, _visited.end());
+
+            // the chains end here, the rest is the next frontier
+            auto found = std::stable_partition(level.begin(), level.end(), [&](const Node& node) {
+                return node._addr >= _config._begin and node._addr < _config._end;
+            });
+            auto chains = static_cast<size_t>(found - level.begin());
+
+            _levels.push_back(std::move(level));
+            for (size_t idx = 0; idx < chains; ++idx) {
+                callback(chain(depth, idx));
+                if (not _config._find_all) {
+                    _done[_levels.back()[idx]._target] = true;
+                }
+            }
+            _chains = chains;
+
+            if (status != Status::Done or std::all_of(_done.begin(), _done.end(), [](bool done) { return done; })) {
+                break;
+            }
+        }
+        return status;
+    }
+
+    template <typename Callback>
+    Status run(uintptr_t target, Callback&& callback)
+    {
+        return run(std::vector<uintptr_t> { target }, callback);
+    }
+};
+
+} // namespace mypower
+
+#endif
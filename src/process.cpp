@@ -16,6 +16,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/mman.h>
 #include <sys/signal.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -23,7 +24,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <unistd.h>
 
 #include <algorithm>
+#include <cstring>
 #include <regex>
+#include <stdexcept>
 
 #include "process.hpp"
 
@@ -108,6 +111,228 @@ ssize_t ProcessLinux::write(struct iovec* local, size_t local_count, struct iove
     return process_vm_writev(_pid, local, local_count, remote, remote_count, 0);
 }
 
+ProcessLinuxMem::ProcessLinuxMem(pid_t pid)
+    : ProcessLinux(pid)
+{
+    auto path = fs::path("/proc") / std::to_string(pid) / "mem";
+    _fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (_fd == -1) {
+        _fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (_fd == -1) {
+        throw std::runtime_error("unable to open " + path.string() + ": " + strerror(errno));
+    }
+}
+
+ProcessLinuxMem::~ProcessLinuxMem()
+{
+    ::close(_fd);
+}
+
+/*
+    A page that can not be accessed fails with EIO. Nothing is transferred
+    without an error only once the address space is gone, report that like
+    process_vm_readv does.
+*/
+static ssize_t mem_result(ssize_t nbytes, size_t size)
+{
+    if (nbytes == 0 and size != 0) {
+        errno = ESRCH;
+        return -1;
+    }
+    return nbytes;
+}
+
+ssize_t ProcessLinuxMem::read(VMAddress address, void* buffer, size_t size)
+{
+    return mem_result(pread64(_fd, buffer, size, static_cast<off64_t>(address.get())), size);
+}
+
+ssize_t ProcessLinuxMem::write(VMAddress address, const void* buffer, size_t size)
+{
+    return mem_result(pwrite64(_fd, buffer, size, static_cast<off64_t>(address.get())), size);
+}
+
+/*
+    One preadv/pwritev per remote iovec, the local iovecs are cut to fit.
+    Like process_vm_readv the transfer stops at the first remote iovec that
+    is not transferred completely, -1 is returned only if nothing was.
+*/
+template <typename Transfer>
+static ssize_t transfer_remote(struct iovec* local, size_t local_count, struct iovec* remote, size_t remote_count, Transfer&& transfer)
+{
+    std::vector<struct iovec> slices {};
+    size_t local_index = 0;
+    size_t local_offset = 0;
+    ssize_t total = 0;
+
+    for (size_t idx = 0; idx < remote_count; ++idx) {
+        auto addr = reinterpret_cast<uintptr_t>(remote[idx].iov_base);
+        size_t want = remote[idx].iov_len;
+
+        while (want) {
+            slices.clear();
+            size_t size = 0;
+            while (want and local_index < local_count and slices.size() < IOV_MAX) {
+                auto& iov = local[local_index];
+                auto len = std::min(want, iov.iov_len - local_offset);
+                if (len) {
+                    slices.push_back(iovec { static_cast<uint8_t*>(iov.iov_base) + local_offset, len });
+                }
+                size += len;
+                want -= len;
+                local_offset += len;
+                if (local_offset == iov.iov_len) {
+                    local_index += 1;
+                    local_offset = 0;
+                }
+            }
+
+            // out of local buffers
+            if (size == 0) {
+                return total;
+            }
+
+            auto nbytes = mem_result(transfer(slices.data(), static_cast<int>(slices.size()), static_cast<off64_t>(addr)), size);
+            if (nbytes < 0) {
+                return total ? total : -1;
+            }
+            total += nbytes;
+            if (static_cast<size_t>(nbytes) != size) {
+                return total;
+            }
+            addr += size;
+        }
+    }
+    return total;
+}
+
+ssize_t ProcessLinuxMem::read(struct iovec* local, size_t local_count, struct iovec* remote, size_t remote_count)
+{
+    return transfer_remote(local, local_count, remote, remote_count, [&](const struct iovec* iov, int count, off64_t offset) {
+        return preadv64(_fd, iov, count, offset);
+    });
+}
+
+ssize_t ProcessLinuxMem::write(struct iovec* local, size_t local_count, struct iovec* remote, size_t remote_count)
+{
+    return transfer_remote(local, local_count, remote, remote_count, [&](const struct iovec* iov, int count, off64_t offset) {
+        return pwritev64(_fd, iov, count, offset);
+    });
+}
+
+void ReadBatch::plan()
+{
+    _order.resize(_requests.size());
+    for (size_t idx = 0; idx < _order.size(); ++idx) {
+        _order[idx] = idx;
+    }
+    std::stable_sort(_order.begin(), _order.end(), [&](size_t a, size_t b) {
+        return _requests[a]._address < _requests[b]._address;
+    });
+
+    _spans.clear();
+    size_t staging = 0;
+    for (size_t pos = 0; pos < _order.size(); ++pos) {
+        auto& request = _requests[_order[pos]];
+        auto begin = request._address;
+        auto end = begin + request._size;
+
+        if (request._size == 0) {
+            continue;
+        }
+
+        if (not _spans.empty()) {
+            auto& span = _spans.back();
+            if (begin <= span._end + _gap) {
+                // two or more requests, read through the staging buffer
+                if (span._staging == SIZE_MAX) {
+                    span._staging = staging;
+                    staging += span._end - span._begin;
+                }
+                if (end > span._end) {
+                    staging += end - span._end;
+                    span._end = end;
+                }
+                span._last = pos + 1;
+                continue;
+            }
+        }
+        _spans.push_back(Span { begin, end, pos, pos + 1, SIZE_MAX, 0 });
+    }
+
+    if (_staging.size() < staging) {
+        _staging.resize(staging);
+    }
+}
+
+void ReadBatch::read_spans(Process& process)
+{
+    static const size_t iov_max = sysconf(_SC_IOV_MAX);
+
+    _local.clear();
+    _remote.clear();
+    for (auto& span : _spans) {
+        auto size = span._end - span._begin;
+        void* buffer = span._staging == SIZE_MAX ? _requests[_order[span._first]]._buffer : _staging.data() + span._staging;
+        _local.push_back(iovec { buffer, size });
+        _remote.push_back(iovec { reinterpret_cast<void*>(span._begin), size });
+    }
+
+    // process_vm_readv stops at the first span it fails to read
+    size_t start = 0;
+    while (start < _spans.size()) {
+        auto count = std::min(_spans.size() - start, iov_max);
+        auto nread = process.read(&_local[start], count, &_remote[start], count);
+
+        if (nread < 0) {
+            nread = process.read(&_local[start], 1, &_remote[start], 1);
+            _spans[start]._valid = nread < 0 ? 0 : nread;
+            start += 1;
+            continue;
+        }
+
+        // go on behind the first short span
+        size_t idx = start;
+        for (; idx < start + count; ++idx) {
+            auto size = _local[idx].iov_len;
+            _spans[idx]._valid = std::min(size, static_cast<size_t>(nread));
+            nread -= _spans[idx]._valid;
+            if (_spans[idx]._valid < size) {
+                idx += 1;
+                break;
+            }
+        }
+        start = idx;
+    }
+}
+
+void ReadBatch::submit(Process& process)
+{
+    plan();
+    read_spans(process);
+
+    for (auto& span : _spans) {
+        for (auto pos = span._first; pos < span._last; ++pos) {
+            auto& request = _requests[_order[pos]];
+            auto offset = request._address - span._begin;
+            request._valid = span._valid > offset ? std::min(request._size, span._valid - offset) : 0;
+
+            if (span._staging == SIZE_MAX) {
+                continue;
+            }
+
+            // the kernel may fail a whole span for one bad page of it
+            if (request._valid < request._size) {
+                auto nread = process.read(VMAddress { request._address }, request._buffer, request._size);
+                request._valid = nread < 0 ? 0 : nread;
+            } else {
+                memcpy(request._buffer, _staging.data() + span._staging + offset, request._size);
+            }
+        }
+    }
+}
+
 static std::tuple<int, int> get_process_user_group(pid_t pid)
 {
     auto path = fs::path { "/proc" } / std::to_string(pid);
@@ -202,4 +427,236 @@ VMRegion::ListType ProcessLinux::get_memory_regions() {
     return VMRegion::snapshot(pid());
 }
 
-} // namespace mypower
\ No newline at end of file
+// pagemap entry, see Documentation/admin-guide/mm/pagemap.rst
+static constexpr uint64_t kPageMapPresent = uint64_t(1) << 63;
+static constexpr uint64_t kPageMapSwapped = uint64_t(1) << 62;
+static constexpr uint64_t kPageMapSoftDirty = uint64_t(1) << 55;
+static constexpr uint64_t kPageMapPFN = (uint64_t(1) << 55) - 1;
+
+static uint64_t read_pagemap_entry(int fd, uintptr_t addr)
+{
+    uint64_t entry = 0;
+    auto offset = static_cast<off_t>(addr / sysconf(_SC_PAGESIZE) * sizeof(entry));
+    if (pread(fd, &entry, sizeof(entry), offset) != sizeof(entry)) {
+        return 0;
+    }
+    return entry;
+}
+
+/*
+    Page frame of the shared zero page, 0 if the page frames are hidden
+    from us. Found by faulting in a page of our own that is never written.
+*/
+static uint64_t get_zero_pfn()
+{
+    static const uint64_t zero_pfn = [] {
+        auto page_size = sysconf(_SC_PAGESIZE);
+        void* page = mmap(nullptr, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            return uint64_t(0);
+        }
+        *reinterpret_cast<volatile uint8_t*>(page);
+
+        uint64_t entry = 0;
+        int fd = ::open("/proc/self/pagemap", O_RDONLY);
+        if (fd != -1) {
+            entry = read_pagemap_entry(fd, reinterpret_cast<uintptr_t>(page));
+            ::close(fd);
+        }
+        munmap(page, page_size);
+        return entry & kPageMapPresent ? entry & kPageMapPFN : 0;
+    }();
+    return zero_pfn;
+}
+
+/*
+    Appends the page ranges of [begin, end) whose pagemap entry
+    select(entry) accepts.
+*/
+template <typename Select>
+static bool read_pagemap_ranges(pid_t pid, VMAddress begin, VMAddress end, std::vector<PageRange>& ranges, Select&& select)
+{
+    auto path = fs::path("/proc") / std::to_string(pid) / "pagemap";
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t first = ranges.size();
+    std::vector<uint64_t> entries(4096);
+    uintptr_t range_begin = 0;
+    bool in_range = false;
+
+    for (auto addr = begin.get(); addr < end.get();) {
+        auto count = std::min(entries.size(), (end.get() - addr) / page_size);
+        auto offset = static_cast<off_t>(addr / page_size * sizeof(uint64_t));
+        auto size = pread(fd, entries.data(), count * sizeof(uint64_t), offset);
+        if (size <= 0 or size % sizeof(uint64_t) != 0) {
+            ranges.erase(ranges.begin() + first, ranges.end());
+            ::close(fd);
+            return false;
+        }
+
+        for (size_t idx = 0; idx < size / sizeof(uint64_t); ++idx, addr += page_size) {
+            bool selected = select(entries[idx]);
+
+            if (selected and not in_range) {
+                range_begin = addr;
+            } else if (not selected and in_range) {
+                ranges.push_back(PageRange { VMAddress { range_begin }, VMAddress { addr } });
+            }
+            in_range = selected;
+        }
+    }
+
+    if (in_range) {
+        ranges.push_back(PageRange { VMAddress { range_begin }, end });
+    }
+
+    ::close(fd);
+    return true;
+}
+
+/*
+    Private anonymous memory reads as zero until it is written. Pages that
+    are neither present nor swapped, or that map the zero page, are left
+    out, so scanning them does not fault them in.
+*/
+bool ProcessLinux::get_present_ranges(const VMRegion& region, std::vector<PageRange>& ranges)
+{
+    if (region._shared or region._inode != 0) {
+        return false;
+    }
+
+    const uint64_t zero_pfn = get_zero_pfn();
+
+    return read_pagemap_ranges(_pid, region._begin, region._end, ranges, [&](uint64_t entry) {
+        return (entry & kPageMapSwapped)
+            or ((entry & kPageMapPresent) and (zero_pfn == 0 or (entry & kPageMapPFN) != zero_pfn));
+    });
+}
+
+/*
+    Whether the file behind a shared mapping keeps its size. Reading a
+    mapped page past the end of a truncated file raises SIGBUS. Shared
+    anonymous and SysV memory can not be resized, memfds only when sealed.
+*/
+static bool stable_mapping(const VMRegion& region, int fd)
+{
+    if (region._file == "/dev/zero" or region._file.rfind("/SYSV", 0) == 0) {
+        return true;
+    }
+#ifdef F_GET_SEALS
+    int seals = fcntl(fd, F_GET_SEALS);
+    return seals != -1 and (seals & F_SEAL_SHRINK);
+#else
+    return false;
+#endif
+}
+
+/*
+    Shared memory of the target whose size can not change is mapped once
+    more through /proc/<pid>/map_files, which needs CAP_SYS_ADMIN, and read
+    in place. Everything else is copied. Our own memory too, another thread
+    may unmap a range while it is compared, a copy fails with EFAULT there
+    instead of faulting.
+*/
+std::shared_ptr<const void> ProcessLinux::map_region(const VMRegion& region, VMAddress begin, VMAddress end)
+{
+    if (not(region._prot & kRegionFlagRead) or begin >= end or _pid == getpid()
+        or not region._shared or region._inode == 0) {
+        return nullptr;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%lx-%lx", static_cast<unsigned long>(region._begin.get()), static_cast<unsigned long>(region._end.get()));
+    auto path = fs::path("/proc") / std::to_string(_pid) / "map_files" / name;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    auto map_begin = begin.get() / page_size * page_size;
+    auto length = end.get() - map_begin;
+    auto offset = region._offset + (map_begin - region._begin.get());
+
+    struct stat buf {
+        0
+    };
+    if (fstat(fd, &buf) != 0 or not S_ISREG(buf.st_mode) or not stable_mapping(region, fd)
+        or offset + length > (static_cast<uintptr_t>(buf.st_size) + page_size - 1) / page_size * page_size) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* ptr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(offset));
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto* view = reinterpret_cast<const uint8_t*>(ptr) + (begin.get() - map_begin);
+    return std::shared_ptr<const void>(view, [ptr, length](const void*) { munmap(ptr, length); });
+}
+
+/*
+    Without CONFIG_MEM_SOFT_DIRTY the bit is never set, every page would
+    look clean. A new mapping starts soft-dirty when it is supported.
+*/
+static bool soft_dirty_supported()
+{
+    static const bool supported = [] {
+        auto page_size = sysconf(_SC_PAGESIZE);
+        void* page = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            return false;
+        }
+        *reinterpret_cast<volatile uint8_t*>(page) = 1;
+
+        uint64_t entry = 0;
+        int fd = ::open("/proc/self/pagemap", O_RDONLY);
+        if (fd != -1) {
+            entry = read_pagemap_entry(fd, reinterpret_cast<uintptr_t>(page));
+            ::close(fd);
+        }
+        munmap(page, page_size);
+        return (entry & kPageMapSoftDirty) != 0;
+    }();
+    return supported;
+}
+
+uint64_t ProcessLinux::clear_soft_dirty()
+{
+    if (not soft_dirty_supported()) {
+        return 0;
+    }
+
+    auto path = fs::path("/proc") / std::to_string(_pid) / "clear_refs";
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    auto nwrite = ::write(fd, "4", 1);
+    ::close(fd);
+    if (nwrite != 1) {
+        return 0;
+    }
+    return ++_soft_dirty_pass;
+}
+
+bool ProcessLinux::get_dirty_ranges(const VMRegion& region, std::vector<PageRange>& ranges)
+{
+    if (_soft_dirty_pass == 0) {
+        return false;
+    }
+
+    return read_pagemap_ranges(_pid, region._begin, region._end, ranges, [](uint64_t entry) {
+        return (entry & kPageMapSoftDirty) != 0;
+    });
+}
+
+} // namespace mypower
@@ -19,6 +19,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <sys/uio.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "vmmap.hpp"
 
 namespace mypower {
@@ -51,10 +55,49 @@ struct Process {
     virtual ProcessState get_process_state() = 0;
 
     virtual VMRegion::ListType get_memory_regions() = 0;
+
+    /*
+        Appends the page ranges of `region` that hold data. Returns false
+        when that is unknown and the whole region has to be read.
+    */
+    virtual bool get_present_ranges(const VMRegion& region, std::vector<PageRange>& ranges)
+    {
+        return false;
+    }
+
+    /*
+        Maps [begin, end) of `region` into our address space so it can be
+        read in place. Returns nullptr when the memory has to be copied.
+    */
+    virtual std::shared_ptr<const void> map_region(const VMRegion& region, VMAddress begin, VMAddress end)
+    {
+        return nullptr;
+    }
+
+    /*
+        Soft-dirty tracking. clear_soft_dirty() starts a new pass and returns
+        its number, 0 if tracking is not supported. get_dirty_ranges()
+        appends the page ranges of `region` written since the pass started.
+    */
+    virtual uint64_t clear_soft_dirty()
+    {
+        return 0;
+    }
+
+    virtual uint64_t soft_dirty_pass() const
+    {
+        return 0;
+    }
+
+    virtual bool get_dirty_ranges(const VMRegion& region, std::vector<PageRange>& ranges)
+    {
+        return false;
+    }
 };
 
 class ProcessLinux : public Process {
     pid_t _pid;
+    std::atomic<uint64_t> _soft_dirty_pass { 0 };
 
 public:
     ProcessLinux(pid_t pid)
@@ -75,6 +118,105 @@ public:
     ProcessState get_process_state() override;
 
     VMRegion::ListType get_memory_regions() override;
+
+    bool get_present_ranges(const VMRegion& region, std::vector<PageRange>& ranges) override;
+
+    std::shared_ptr<const void> map_region(const VMRegion& region, VMAddress begin, VMAddress end) override;
+
+    uint64_t clear_soft_dirty() override;
+    uint64_t soft_dirty_pass() const override { return _soft_dirty_pass; }
+    bool get_dirty_ranges(const VMRegion& region, std::vector<PageRange>& ranges) override;
+};
+
+/*
+    Reads and writes through /proc/<pid>/mem instead of process_vm_readv.
+    pread on the mem file is not subject to the restrictions some kernels
+    put on process_vm_readv, and the scanner threads share the fd.
+*/
+class ProcessLinuxMem : public ProcessLinux {
+    int _fd { -1 };
+
+public:
+    ProcessLinuxMem(pid_t pid);
+    ProcessLinuxMem(const ProcessLinuxMem&) = delete;
+    ProcessLinuxMem& operator=(const ProcessLinuxMem&) = delete;
+    ~ProcessLinuxMem();
+
+    ssize_t read(VMAddress address, void* buffer, size_t size) override;
+    ssize_t write(VMAddress address, const void* buffer, size_t size) override;
+    ssize_t read(struct iovec* local, size_t local_count, struct iovec* remote, size_t remote_count) override;
+    ssize_t write(struct iovec* local, size_t local_count, struct iovec* remote, size_t remote_count) override;
+};
+
+/*
+    Many small reads with few syscalls. add() queues a read of `size`
+    bytes at `address` into `buffer`. submit() sorts the requests, merges
+    the ones less than `gap` bytes apart into one span, reads the spans
+    IOV_MAX at a time and sets the bytes read of every request. A merged
+    span that comes back short is read again request by request, so one
+    unreadable request does not fail its neighbours.
+*/
+class ReadBatch {
+    struct Request {
+        uintptr_t _address;
+        size_t _size;
+        void* _buffer;
+        size_t _valid;
+    };
+
+    struct Span {
+        uintptr_t _begin;
+        uintptr_t _end;
+        // range of _order
+        size_t _first;
+        size_t _last;
+        // offset in _staging, SIZE_MAX when read into the buffer of the request
+        size_t _staging;
+        size_t _valid;
+    };
+
+    size_t _gap;
+    std::vector<Request> _requests {};
+    std::vector<size_t> _order {};
+    std::vector<Span> _spans {};
+    std::vector<uint8_t> _staging {};
+    std::vector<struct iovec> _local {};
+    std::vector<struct iovec> _remote {};
+
+    void plan();
+    void read_spans(Process& process);
+
+public:
+    explicit ReadBatch(size_t gap = 0)
+        : _gap(gap)
+    {
+    }
+
+    // returns the index of the request
+    size_t add(VMAddress address, void* buffer, size_t size)
+    {
+        _requests.push_back(Request { address.get(), size, buffer, 0 });
+        return _requests.size() - 1;
+    }
+
+    size_t size() const { return _requests.size(); }
+
+    bool empty() const { return _requests.empty(); }
+
+    void submit(Process& process);
+
+    // bytes read for the request, up to its size
+    size_t valid(size_t index) const { return _requests[index]._valid; }
+
+    bool ok(size_t index) const { return _requests[index]._valid == _requests[index]._size; }
+
+    // the requests are dropped, the buffers are kept for the next batch
+    void clear()
+    {
+        _requests.clear();
+        _order.clear();
+        _spans.clear();
+    }
 };
 
 class AutoSuspendResume {
@@ -27,19 +27,20 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <sstream>
+#include <thread>
 
 #include "comparator.hpp"
+#include "matchstore.hpp"
 #include "matchvalue.hpp"
+#include "pagesnapshot.hpp"
 #include "process.hpp"
-
-#if USE_SIMD
-#include <simdjson/arm64/simd.h>
-#include <simdjson/dom.h>
-#include <simdjson/implementations.h>
-#endif
+#include "simd.hpp"
 
 #define LIKELY(x) __builtin_expect((x), 1)
 #define UNLIKELY(x) __builtin_expect((x), 0)
@@ -48,46 +49,311 @@ namespace mypower {
 
 using namespace std::string_literals;
 
+/*
+    Chunk buffers are mapped once and handed from one MemoryMapper to the
+    next, instead of every region mapping and unmapping its own. Session
+    trims the pool after each pass over the memory.
+*/
+class BufferPool {
+public:
+    struct Buffer {
+        void* _ptr;
+        size_t _size;
+    };
+
+private:
+    static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    std::mutex _mutex {};
+    std::vector<Buffer> _free {};
+
+public:
+    ~BufferPool()
+    {
+        trim();
+    }
+
+    static BufferPool& instance()
+    {
+        static BufferPool pool {};
+        return pool;
+    }
+
+    // the smallest free buffer of at least `size` bytes
+    Buffer acquire(size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock { _mutex };
+            auto best = _free.end();
+            for (auto iter = _free.begin(); iter != _free.end(); ++iter) {
+                if (iter->_size >= size and (best == _free.end() or iter->_size < best->_size)) {
+                    best = iter;
+                }
+            }
+            if (best != _free.end()) {
+                auto buffer = *best;
+                _free.erase(best);
+                return buffer;
+            }
+        }
+
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+        if (ptr == MAP_FAILED) {
+            throw std::runtime_error("Out of memory");
+        }
+#ifdef MADV_HUGEPAGE
+        // fewer TLB misses while the chunks are compared, a hint only
+        if (size >= kHugePageSize) {
+            madvise(ptr, size, MADV_HUGEPAGE);
+        }
+#endif
+        return Buffer { ptr, size };
+    }
+
+    void release(Buffer buffer)
+    {
+        std::lock_guard<std::mutex> lock { _mutex };
+        _free.push_back(buffer);
+    }
+
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock { _mutex };
+        for (auto& buffer : _free) {
+            munmap(buffer._ptr, buffer._size);
+        }
+        _free.clear();
+    }
+};
+
+/*
+    A reader thread that runs one task at a time for the thread that owns
+    it. Every scanning thread gets its own on first use, and keeps it for
+    all the chunks and ranges it reads after that.
+*/
+class ReadAhead {
+    std::mutex _mutex {};
+    std::condition_variable _cond {};
+    std::function<void()> _task {};
+    bool _busy { false };
+    bool _stop { false };
+    std::thread _thread;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock { _mutex };
+        while (true) {
+            _cond.wait(lock, [this] { return _busy or _stop; });
+            if (not _busy) {
+                return;
+            }
+
+            lock.unlock();
+            _task();
+            lock.lock();
+
+            _task = nullptr;
+            _busy = false;
+            _cond.notify_all();
+        }
+    }
+
+public:
+    ReadAhead()
+        : _thread(&ReadAhead::run, this)
+    {
+    }
+
+    ~ReadAhead()
+    {
+        {
+            std::unique_lock<std::mutex> lock { _mutex };
+            _cond.wait(lock, [this] { return not _busy; });
+            _stop = true;
+        }
+        _cond.notify_all();
+        _thread.join();
+    }
+
+    static ReadAhead& instance()
+    {
+        thread_local ReadAhead reader {};
+        return reader;
+    }
+
+    // waits for the task before
+    void submit(std::function<void()> task)
+    {
+        {
+            std::unique_lock<std::mutex> lock { _mutex };
+            _cond.wait(lock, [this] { return not _busy; });
+            _task = std::move(task);
+            _busy = true;
+        }
+        _cond.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock { _mutex };
+        _cond.wait(lock, [this] { return not _busy; });
+    }
+};
+
+/*
+    Reads [begin_addr, end_addr) chunk by chunk. Positions are taken every
+    `step` bytes from begin_addr and each one needs `size` bytes, so the
+    bytes of positions that do not fit in a chunk are carried over to the
+    front of the next one. Pages that fail to read are skipped and
+    recorded, the rest of the range is still read.
+
+    There are two chunk buffers. While the caller works on one, the next
+    chunk is read into the other by the ReadAhead of the calling thread. A chunk is never
+    larger than the range, so small regions take small buffers.
+*/
 class MemoryMapper {
+    struct ReadResult {
+        ssize_t _size;
+        int _error;
+    };
+
     std::shared_ptr<Process> _process;
+    VMAddress _origin;
     VMAddress _begin_addr;
     VMAddress _end_addr;
+    VMAddress _read_addr;
+    // positions from here on belong to the next unit
+    VMAddress _limit;
     size_t _size;
     size_t _step;
-    void* _cache { MAP_FAILED };
+    BufferPool::Buffer _cache { nullptr, 0 };
     void* _backup;
+    void* _buffers[2];
     size_t _cache_capacity;
     size_t _page_size;
-    size_t _total_memory;
+    size_t _headroom;
 
-    ssize_t _cached_size { 0 };
-    ssize_t _backup_size { 0 };
+    size_t _backup_size { 0 };
     void* _begin { nullptr };
     void* _end { nullptr };
+    void* _tail { nullptr };
+    void* _owned { nullptr };
+
+    // buffer of the chunk at _read_addr
+    size_t _current { 0 };
+    ReadAhead* _reader { nullptr };
+    bool _prefetching { false };
+    ReadResult _prefetched { 0, 0 };
+
+    // known to be unreadable, and found unreadable by this mapper
+    const std::vector<PageRange>* _skip { nullptr };
+    std::vector<PageRange> _unreadable {};
+
+    // the range mapped by the process, read in place
+    std::shared_ptr<const void> _view {};
+
+    // where the positions of the chunk at _begin_addr stop, between end() and tail()
+    void* owned_end() const
+    {
+        auto end = reinterpret_cast<uintptr_t>(_end);
+        auto limit = reinterpret_cast<uintptr_t>(_begin) + (_limit.get() - std::min(_limit.get(), _begin_addr.get()));
+        return reinterpret_cast<void*>(std::max(end, std::min(limit, reinterpret_cast<uintptr_t>(_tail))));
+    }
+
+    // bytes to read at addr, up to the next page known to be unreadable
+    size_t read_size(VMAddress addr) const
+    {
+        auto size = std::min(_cache_capacity, (_end_addr - addr).get());
+        if (_skip != nullptr) {
+            auto iter = find_page_range(*_skip, addr.get());
+            if (iter != _skip->end() and iter->_begin.get() < addr.get() + size) {
+                size = iter->_begin.get() > addr.get() ? iter->_begin.get() - addr.get() : 0;
+            }
+        }
+        return size;
+    }
+
+    ReadResult read(VMAddress addr, size_t buffer)
+    {
+        auto size = read_size(addr);
+        if (size == 0) {
+            return ReadResult { 0, 0 };
+        }
+        auto nread = _process->read(addr, _buffers[buffer], size);
+        return ReadResult { nread, nread < 0 ? errno : 0 };
+    }
+
+    /*
+        Length of the readable bytes at addr after a short read. A partial
+        read already stops at the failing page. A backend that fails the
+        whole read instead is bisected down to the failing page.
+    */
+    size_t readable_prefix(VMAddress addr, size_t nread, size_t read_size)
+    {
+        if (nread != 0) {
+            return nread;
+        }
+
+        void* buffer = _buffers[_current];
+        auto first = std::min((addr.get() / _page_size + 1) * _page_size - addr.get(), read_size);
+        if (_process->read(addr, buffer, first) != static_cast<ssize_t>(first)) {
+            return 0;
+        }
+        if (first == read_size) {
+            return first;
+        }
+
+        // reading `first` and `low` more pages succeeds, `high` more pages fails
+        size_t low = 0;
+        size_t high = (read_size - first + _page_size - 1) / _page_size;
+        while (high - low > 1) {
+            auto middle = low + (high - low) / 2;
+            auto size = std::min(first + middle * _page_size, read_size);
+            if (_process->read(addr, buffer, size) == static_cast<ssize_t>(size)) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+
+        auto size = first + low * _page_size;
+        _process->read(addr, buffer, size);
+        return size;
+    }
 
 public:
-    MemoryMapper(std::shared_ptr<Process>& process, VMAddress begin_addr, VMAddress end_addr, size_t step, size_t cache_capacity = 8 * 1024 * 1024 /* 8M Byte */)
+    MemoryMapper(std::shared_ptr<Process>& process, VMAddress begin_addr, VMAddress end_addr, size_t step, size_t size, size_t cache_capacity = 8 * 1024 * 1024 /* 8M Byte */)
         : _process(process)
+        , _origin(begin_addr)
         , _begin_addr(begin_addr)
         , _end_addr { end_addr }
+        , _read_addr { begin_addr }
+        , _limit { end_addr }
+        , _size(std::max(size, size_t { 1 }))
         , _step(step)
-        , _cache_capacity(cache_capacity)
         , _page_size(sysconf(_SC_PAGESIZE))
     {
-        _total_memory = _cache_capacity + (2 * _page_size);
-        _cache = mmap(nullptr, _total_memory, PROT_READ | PROT_WRITE,
-            MAP_ANON | MAP_PRIVATE, -1, 0);
-        if (_cache == MAP_FAILED) {
-            throw std::runtime_error("Out of memory");
-        }
-        _backup = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_cache) + _cache_capacity + _page_size);
+        auto range = (end_addr.get() - begin_addr.get() + _page_size - 1) / _page_size * _page_size;
+        _cache_capacity = std::max(std::min(cache_capacity, range), _page_size);
+
+        // room for the carried bytes in front of each buffer
+        _headroom = (std::max(_size, _step) + _page_size - 1) / _page_size * _page_size;
+        _cache = BufferPool::instance().acquire(2 * (_headroom + _cache_capacity) + _headroom);
+        auto base = reinterpret_cast<uintptr_t>(_cache._ptr);
+        _buffers[0] = reinterpret_cast<void*>(base + _headroom);
+        _buffers[1] = reinterpret_cast<void*>(base + _headroom + _cache_capacity + _headroom);
+        _backup = reinterpret_cast<void*>(base + 2 * (_headroom + _cache_capacity));
     }
 
     ~MemoryMapper()
     {
-        if (_cache != MAP_FAILED) {
-            munmap(_cache, _total_memory);
-            _cache = MAP_FAILED;
+        // the reader thread may still write to the buffers
+        if (_prefetching) {
+            _reader->wait();
+        }
+
+        if (_cache._ptr != nullptr) {
+            BufferPool::instance().release(_cache);
         }
     }
 
@@ -96,62 +362,406 @@ public:
         return _step;
     }
 
+    // sorted ranges that are not read, call before next()
+    void skip(const std::vector<PageRange>* ranges)
+    {
+        _skip = ranges;
+    }
+
+    // the positions from `limit` on are handed out by the next unit, call before next()
+    void own(VMAddress limit)
+    {
+        _limit = limit;
+    }
+
+    // the pages that failed to read, sorted
+    const std::vector<PageRange>& unreadable() const
+    {
+        return _unreadable;
+    }
+
+    /*
+        Uses the range in place when the process can map it, the range is
+        then a single chunk and nothing is copied. Call after skip().
+    */
+    bool map(const VMRegion& region)
+    {
+        if (_skip != nullptr) {
+            auto iter = find_page_range(*_skip, _origin.get());
+            if (iter != _skip->end() and iter->_begin < _end_addr) {
+                return false;
+            }
+        }
+
+        _view = _process->map_region(region, _origin, _end_addr);
+        if (_view == nullptr) {
+            return false;
+        }
+
+        BufferPool::instance().release(_cache);
+        _cache = BufferPool::Buffer { nullptr, 0 };
+        return true;
+    }
+
     VMAddress address_begin() const { return _begin_addr; }
     VMAddress address_end() const { return _end_addr; }
 
     void* begin() { return _begin; }
     void* end() { return _end; }
 
+    /*
+        End of the bytes behind end() that no later chunk hands out again.
+        Values narrower than `size` may still start there, in front of
+        owned(). It is end() unless the chunk is the last one before the
+        range end or a hole.
+    */
+    void* tail() { return _tail; }
+
+    void* owned() { return _owned; }
+
+    /*
+        An unreadable page ends the chunk before it, as if the range ended
+        there, and the positions start over behind it.
+    */
     bool next()
     {
-        auto addr = _begin_addr + _cached_size;
-        if (addr >= _end_addr) {
-            return false;
-        }
-        void* cache = _backup_size == 0 ? _cache : reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_cache) + _page_size);
-        auto read_size = std::min(_cache_capacity, (_end_addr - addr).get());
-        _cached_size = _process->read(addr, cache, read_size);
-        if (_cached_size == -1) {
-            std::ostringstream oss {};
-            oss << "Read memory failed: "s + strerror(errno) << ". "
-                << std::hex << "0x" << addr.get() << " (0x" << read_size << ")";
-            throw std::runtime_error(oss.str());
+        if (_view != nullptr) {
+            if (_read_addr >= _end_addr) {
+                return false;
+            }
+            auto range = (_end_addr - _origin).get();
+            size_t count = range >= _size ? (range - _size) / _step + 1 : 0;
+            _begin = const_cast<void*>(_view.get());
+            _end = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_begin) + count * _step);
+            _tail = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_begin) + range);
+            _owned = owned_end();
+            _begin_addr = _origin;
+            _read_addr = _end_addr;
+            return true;
         }
 
-        auto next_backup_size = _cached_size % _step;
+        while (_read_addr < _end_addr) {
+            auto addr = _read_addr;
+            auto read_size = this->read_size(addr);
 
-        if (_backup_size == 0) {
-            _begin = cache;
-        } else {
-            _begin = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_cache) + _page_size - _backup_size);
+            // the first chunk is read here, the others were prefetched
+            ReadResult result;
+            if (_prefetching) {
+                _reader->wait();
+                _prefetching = false;
+                result = _prefetched;
+            } else {
+                result = read(addr, _current);
+            }
+            if (result._size < 0 and result._error == ESRCH) {
+                std::ostringstream oss {};
+                oss << "Read memory failed: "s + strerror(result._error) << ". "
+                    << std::hex << "0x" << addr.get() << " (0x" << read_size << ")";
+                throw std::runtime_error(oss.str());
+            }
+
+            size_t cached_size = result._size < 0 ? 0 : result._size;
+            uintptr_t hole_end = 0;
+            if (read_size == 0) {
+                hole_end = find_page_range(*_skip, addr.get())->_end.get();
+            } else if (cached_size < read_size) {
+                cached_size = readable_prefix(addr, cached_size, read_size);
+                auto hole_begin = addr.get() + cached_size;
+                hole_end = (hole_begin / _page_size + 1) * _page_size;
+                add_page_range(_unreadable, VMAddress { hole_begin }, VMAddress { hole_end });
+            }
+
+            void* cache = _buffers[_current];
+            _begin = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(cache) - _backup_size);
             memcpy(_begin, _backup, _backup_size);
+
+            _begin_addr = addr - _backup_size;
+            _read_addr = addr + cached_size;
+
+            // the last chunk only needs `size` bytes per position, the others keep
+            // a whole step so the carried bytes always start at a position
+            bool last = hole_end != 0 or _read_addr >= _end_addr;
+            size_t available = _backup_size + cached_size;
+            size_t span = last ? _size : std::max(_size, _step);
+            size_t count = available >= span ? (available - span) / _step + 1 : 0;
+
+            _end = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_begin) + count * _step);
+            _tail = last ? reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_begin) + available) : _end;
+            _owned = owned_end();
+            if (not last) {
+                _backup_size = available - count * _step;
+                memcpy(_backup, _end, _backup_size);
+            } else {
+                _backup_size = 0;
+            }
+
+            if (hole_end != 0) {
+                auto skipped = (hole_end - _origin.get() + _step - 1) / _step * _step;
+                _read_addr = std::min(_origin + skipped, _end_addr);
+            }
+
+            // nothing to hand out in front of the hole, go on reading
+            if (available == 0 and hole_end != 0) {
+                continue;
+            }
+
+            if (_read_addr < _end_addr) {
+                // the caller works on this buffer until the next call
+                _current ^= 1;
+                if (_reader == nullptr) {
+                    _reader = &ReadAhead::instance();
+                }
+                _reader->submit([this, addr = _read_addr, buffer = _current] {
+                    _prefetched = read(addr, buffer);
+                });
+                _prefetching = true;
+            }
+            return true;
         }
+        return false;
+    }
+};
 
-        _end = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(_begin) + _cached_size - next_backup_size);
-        memcpy(_backup, _end, next_backup_size);
-        _backup_size = next_backup_size;
+/*
+    Reads the values of many matches with few syscalls. Sorted matches are
+    grouped into spans of the pages they live on, and the spans are read
+    by a ReadBatch into one buffer, so the callback sees every value in
+    place. A span never crosses a region, and a span the process fails to
+    read, or that lies on pages known to be unreadable, is passed to the
+    callback as nullptr.
+*/
+class MatchReader {
+    struct Span {
+        uintptr_t _begin;
+        uintptr_t _end;
+        const VMRegion* _region;
+        size_t _first;
+        size_t _last;
+        size_t _valid;
+    };
 
-        _begin_addr = addr;
-        return true;
+    std::shared_ptr<Process> _process;
+    const VMRegion::ListType& _regions;
+    size_t _capacity;
+    size_t _page_size;
+
+    std::vector<uint8_t> _buffer {};
+    std::vector<Span> _spans {};
+    ReadBatch _batch {};
+    size_t _batch_size { 0 };
+
+    template <typename M, typename Callback, typename Select>
+    void flush(M& matches, size_t value_size, Callback& callback, Select& select)
+    {
+        if (_spans.empty()) {
+            return;
+        }
+
+        if (_buffer.size() < _batch_size) {
+            _buffer.resize(_batch_size);
+        }
+
+        _batch.clear();
+        size_t offset = 0;
+        for (auto& span : _spans) {
+            _batch.add(VMAddress { span._begin }, _buffer.data() + offset, span._end - span._begin);
+            offset += span._end - span._begin;
+        }
+        _batch.submit(*_process);
+        for (size_t idx = 0; idx < _spans.size(); ++idx) {
+            _spans[idx]._valid = _batch.valid(idx);
+        }
+
+        offset = 0;
+        for (auto& span : _spans) {
+            for (size_t idx = span._first; idx < span._last; ++idx) {
+                if (not select(idx)) {
+                    continue;
+                }
+                auto addr = matches.address(idx);
+                if (addr + value_size - span._begin <= span._valid) {
+                    callback(idx, _buffer.data() + offset + (addr - span._begin));
+                } else {
+                    callback(idx, nullptr);
+                }
+            }
+            offset += span._end - span._begin;
+        }
+
+        _spans.clear();
+        _batch_size = 0;
+    }
+
+public:
+    MatchReader(std::shared_ptr<Process>& process, const VMRegion::ListType& regions, size_t capacity)
+        : _process(process)
+        , _regions(regions)
+        , _capacity(capacity)
+        , _page_size(sysconf(_SC_PAGESIZE))
+    {
+    }
+
+    /*
+        matches is a MatchStore chunk. callback(index, ptr) is called once
+        for every match select(index) accepts, in index order, with ptr
+        pointing at value_size bytes read from the match address
+    */
+    template <typename M, typename Callback, typename Select>
+    void read(M& matches, size_t value_size, Callback&& callback, Select&& select)
+    {
+        auto region = _regions.begin();
+
+        for (size_t idx = 0; idx < matches.size(); ++idx) {
+            if (not select(idx)) {
+                continue;
+            }
+
+            auto addr = matches.address(idx);
+            uintptr_t begin = addr;
+            uintptr_t end = addr + value_size;
+            const VMRegion* owner = nullptr;
+
+            while (region != _regions.end() and region->_end.get() <= addr) {
+                ++region;
+            }
+
+            if (region != _regions.end() and addr >= region->_begin.get() and end <= region->_end.get()) {
+                auto hole = find_page_range(region->_unreadable, addr);
+                if (hole != region->_unreadable.end() and hole->_begin.get() < end) {
+                    // an empty span, the known unreadable pages are not read again
+                    end = begin;
+                } else {
+                    owner = &*region;
+                    begin = std::max(addr / _page_size * _page_size, region->_begin.get());
+                    end = std::min((end + _page_size - 1) / _page_size * _page_size, region->_end.get());
+                }
+            }
+
+            if (not _spans.empty()) {
+                auto& span = _spans.back();
+                auto grow = end > span._end ? end - span._end : 0;
+
+                if (owner != nullptr and span._region == owner
+                    and begin >= span._begin and begin <= span._end
+                    and _batch_size + grow <= _capacity) {
+                    span._end += grow;
+                    span._last = idx + 1;
+                    _batch_size += grow;
+                    continue;
+                }
+            }
+
+            if (_batch_size + (end - begin) > _capacity) {
+                flush(matches, value_size, callback, select);
+            }
+
+            _spans.emplace_back(Span { begin, end, owner, idx, idx + 1, 0 });
+            _batch_size += end - begin;
+        }
+
+        flush(matches, value_size, callback, select);
+    }
+
+    template <typename M, typename Callback>
+    void read(M& matches, size_t value_size, Callback&& callback)
+    {
+        read(matches, value_size, callback, [](size_t) { return true; });
     }
 };
 
+class ScanMultiple;
+
+// scanners that take the tail of the last chunk too, see MemoryMapper::tail()
+template <typename T>
+struct ScansTail : std::false_type { };
+
+template <>
+struct ScansTail<ScanMultiple> : std::true_type { };
+
 class Session {
+    // chunks per scan unit
+    static constexpr size_t kScanUnitChunks = 4;
+
     std::shared_ptr<Process> _process;
     VMRegion::ListType _memory_regions;
+    RegionIndex _region_index {};
     size_t _cache_size;
-
-#define __MATCHES(t) std::vector<Match##t> _matches_##t;
+    PageSnapshot _snapshot {};
+    // skip anonymous pages that hold no data, see Process::get_present_ranges
+    bool _present_pages_only { false };
+
+    // soft-dirty pass the matches were read in, 0 if the pages are not tracked
+    bool _track_dirty_pages { false };
+    uint64_t _dirty_pass { 0 };
+    // pages written since the matches were read, sorted by address
+    std::vector<PageRange> _dirty_pages {};
+    bool _skip_clean_pages { false };
+
+#define __MATCHES(t) MatchStore<type##t> _matches_##t;
     MATCH_TYPES(__MATCHES);
 #undef __MATCHES
 
+    // matches found in one scan unit
+    struct MatchBuffer {
+#define __MATCHES(t) MatchStore<type##t> _matches_##t;
+        MATCH_TYPES(__MATCHES);
+#undef __MATCHES
+
+        explicit MatchBuffer(size_t step)
+        {
+#define __STEP(t) _matches_##t = MatchStore<type##t> { step };
+            MATCH_TYPES(__STEP);
+#undef __STEP
+        }
+
+        template <typename T>
+        void add_match(T&& match)
+        {
+#define __ADD_MATCH(t)                                \
+    if constexpr (std::is_same<T, Match##t>::value) { \
+        _matches_##t.push_back(std::move(match));     \
+    }
+
+            MATCH_TYPES(__ADD_MATCH);
+#undef __ADD_MATCH
+        }
+    };
+
+    void merge(MatchBuffer& buffer)
+    {
+#define __MERGE(t) \
+    _matches_##t.append(std::move(buffer._matches_##t));
+
+        MATCH_TYPES(__MERGE);
+#undef __MERGE
+    }
+
 public:
-    Session(std::shared_ptr<Process>& process, size_t cache_size)
+    Session(std::shared_ptr<Process>& process, size_t cache_size = default_cache_size())
         : _process(process)
         , _cache_size(cache_size)
     {
     }
 
+    /*
+        Chunk size for the memory reads. A chunk and the one prefetched
+        behind it fit in the L2 cache, so comparing a chunk rarely misses.
+    */
+    static size_t default_cache_size()
+    {
+        static const size_t cache_size = [] {
+            long l2_size = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+            l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+            if (l2_size <= 0) {
+                return size_t { 1024 * 1024 };
+            }
+            return std::clamp(static_cast<size_t>(l2_size) / 2, size_t { 256 * 1024 }, size_t { 8 * 1024 * 1024 });
+        }();
+        return cache_size;
+    }
+
     ~Session()
     {
     }
@@ -159,28 +769,144 @@ public:
     void update_memory_region()
     {
         _memory_regions = _process->get_memory_regions();
+        _region_index = RegionIndex { _memory_regions };
     }
 
     template <typename T>
     void update_memory_region(T&& regions)
     {
         _memory_regions = std::forward<T>(regions);
+        _region_index = RegionIndex { _memory_regions };
     }
 
-    template <typename T>
-    void find_region(VMAddress addr, T&& cb)
+    /*
+        Replaces the region list like update_memory_region(), and drops the
+        matches on ranges that were unmapped or mapped to something else
+        since, so the filters do not read dead addresses. The unreadable
+        pages of the regions that stay are kept. Returns the number of
+        matches dropped.
+    */
+    size_t refresh_memory_region()
+    {
+        return refresh_memory_region(_process->get_memory_regions());
+    }
+
+    size_t refresh_memory_region(VMRegion::ListType regions)
     {
+        // maps could not be read, nothing is known about the addresses
+        if (regions.empty()) {
+            return 0;
+        }
+
+        auto diff = diff_regions(_memory_regions, regions);
+        RegionIndex index { regions };
+
         for (auto& region : _memory_regions) {
-            if (addr >= region._begin and addr < region._end) {
-                cb(region);
-                break;
+            for (auto& range : region._unreadable) {
+                auto found = index.find(range._begin.get());
+                if (found != RegionIndex::npos and same_mapping(region, regions[found])) {
+                    regions[found].add_unreadable(range._begin, std::min(range._end, regions[found]._end));
+                }
+            }
+        }
+
+        size_t dropped = 0;
+        if (not diff._removed.empty()) {
+#define __ERASE(t) \
+    dropped += _matches_##t.erase(diff._removed, std::is_arithmetic<type##t>::value ? sizeof(type##t) : 1);
+            MATCH_TYPES(__ERASE);
+#undef __ERASE
+
+            auto& blocks = _snapshot._blocks;
+            blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&](const SnapshotBlock& block) {
+                auto iter = find_page_range(diff._removed, block.begin().get());
+                return iter != diff._removed.end() and iter->_begin <= block.begin() and iter->_end >= block.begin() + block.size();
+            }),
+                blocks.end());
+        }
+
+        _memory_regions = std::move(regions);
+        _region_index = std::move(index);
+        return dropped;
+    }
+
+    void present_pages_only(bool enable)
+    {
+        _present_pages_only = enable;
+    }
+
+    void track_dirty_pages(bool enable)
+    {
+        _track_dirty_pages = enable;
+    }
+
+    /*
+        Starts a new soft-dirty pass, call before the memory is read. If the
+        matches were read in the current pass of the process, the pages
+        written since are collected and filters take the values of the
+        matches on other pages as they are.
+    */
+    void begin_dirty_pass()
+    {
+        _dirty_pages.clear();
+        _skip_clean_pages = false;
+
+        if (not _track_dirty_pages) {
+            _dirty_pass = 0;
+            return;
+        }
+
+        // writes between reading the pagemap and clearing it would be lost
+        AutoSuspendResume suspend { _process, false, _process->pid() != ::getpid() };
+
+        // another session of the process may have started a pass since
+        if (_dirty_pass != 0 and _dirty_pass == _process->soft_dirty_pass()) {
+            _skip_clean_pages = true;
+
+            for (auto& region : _memory_regions) {
+                if ((region._prot & kRegionFlagRead) == 0) {
+                    continue;
+                }
+                if (not _process->get_dirty_ranges(region, _dirty_pages)) {
+                    _dirty_pages.push_back(PageRange { region._begin, region._end });
+                }
             }
         }
+
+        _dirty_pass = _process->clear_soft_dirty();
+    }
+
+    bool page_dirty(uintptr_t begin, uintptr_t end) const
+    {
+        if (not _skip_clean_pages) {
+            return true;
+        }
+
+        auto iter = find_page_range(_dirty_pages, begin);
+        return iter != _dirty_pages.end() and iter->_begin.get() < end;
+    }
+
+    const VMRegion::ListType& memory_regions() const
+    {
+        return _memory_regions;
+    }
+
+    template <typename T>
+    void find_region(VMAddress addr, T&& cb)
+    {
+        auto index = region_index(addr.get());
+        if (index < _memory_regions.size()) {
+            cb(_memory_regions[index]);
+        }
     }
 
     void reset()
     {
         _memory_regions.clear();
+        _region_index = RegionIndex {};
+        _snapshot.clear();
+        _dirty_pages.clear();
+        _dirty_pass = 0;
 
 #define __RESET(t) \
     _matches_##t.clear();
@@ -226,150 +952,533 @@ public:
         throw std::out_of_range(oss.str());
     }
 
-#define __BEGIN(t)                   \
-    auto t##_begin()                 \
-    {                                \
-        return _matches_##t.begin(); \
+#define __BEGIN(t)                   \
+    auto t##_begin()                 \
+    {                                \
+        return _matches_##t.begin(); \
+    }
+
+    MATCH_TYPES(__BEGIN);
+#undef __BEGIN
+
+#define __END(t)                   \
+    auto t##_end()                 \
+    {                              \
+        return _matches_##t.end(); \
+    }
+
+    MATCH_TYPES(__END);
+#undef __END
+
+#define __SIZE(t)                   \
+    size_t t##_size() const         \
+    {                               \
+        return _matches_##t.size(); \
+    }
+
+    MATCH_TYPES(__SIZE);
+#undef __SIZE
+
+#define __AT(t)                        \
+    auto t##_at(size_t index) const    \
+    {                                  \
+        return _matches_##t.at(index); \
+    }
+
+    MATCH_TYPES(__AT);
+#undef __AT
+
+    template <typename T>
+    void add_match(T&& match)
+    {
+#define __ADD_MATCH(t)                                \
+    if constexpr (std::is_same<T, Match##t>::value) { \
+        _matches_##t.push_back(std::move(match));     \
+    }
+
+        MATCH_TYPES(__ADD_MATCH);
+#undef __ADD_MATCH
+    }
+
+    struct ScanUnit {
+        VMAddress _begin;
+        VMAddress _end;
+        // end of the positions the unit owns
+        VMAddress _limit;
+        // index in _memory_regions
+        size_t _region;
+    };
+
+    // index of the region holding addr, _memory_regions.size() if there is none
+    size_t region_index(uintptr_t addr) const
+    {
+        auto index = _region_index.find(addr);
+        return index == RegionIndex::npos ? _memory_regions.size() : index;
+    }
+
+    // later scans and filters skip the pages that failed to read
+    void record_unreadable(size_t region, const std::vector<PageRange>& ranges)
+    {
+        for (auto& range : ranges) {
+            _memory_regions.at(region).add_unreadable(range._begin, range._end);
+        }
+    }
+
+    /*
+        Splits the scanned regions into units of the same size, so one huge
+        region is shared by all threads instead of being scanned by one.
+        A unit owns the positions in [_begin, _limit) and reads up to
+        `overlap` more bytes for the values that straddle its end. With
+        _present_pages_only, units only cover the pages that hold data.
+    */
+    std::vector<ScanUnit> split_regions(uint32_t prot, bool exclude_file, size_t step, size_t size)
+    {
+        std::vector<ScanUnit> units {};
+        std::vector<PageRange> ranges {};
+
+        const size_t unit_size = std::max(_cache_size * kScanUnitChunks / step * step, step);
+        const size_t overlap = size > step ? size - step : 0;
+
+        for (size_t index = 0; index < _memory_regions.size(); ++index) {
+            auto& region = _memory_regions[index];
+
+            if ((region._prot & prot) != prot) {
+                continue;
+            }
+
+#ifdef __ANDROID__
+            if (region._desc.find("anon:dalvik-") != std::string::npos) {
+                continue;
+            }
+            if (region._file.find("/dev/kgsl") != std::string::npos) {
+                continue;
+            }
+#endif
+
+            if (exclude_file and not region._android_bss and not region._file.empty()) {
+                continue;
+            }
+
+            ranges.clear();
+            if (not(_present_pages_only and _process->get_present_ranges(region, ranges))) {
+                ranges.push_back(PageRange { region._begin, region._end });
+            }
+
+            for (auto& range : ranges) {
+                // the overlap stays inside the range, the pages past it are absent
+                for (auto begin = range._begin; begin < range._end; begin += unit_size) {
+                    auto owned = std::min(begin + unit_size, range._end);
+                    auto end = std::min(owned + overlap, range._end);
+                    units.push_back(ScanUnit { begin, end, owned, index });
+                }
+            }
+        }
+        return units;
+    }
+
+    template <typename T>
+    void scan(T&& scanner, uint32_t prot, bool exclude_file=false)
+    {
+        begin_dirty_pass();
+
+        auto units = split_regions(prot, exclude_file, scanner.step(), scanner.size());
+
+        // one buffer per unit, so merging them in unit order sorts the matches by address
+        std::vector<MatchBuffer> buffers(units.size(), MatchBuffer { scanner.step() });
+        std::vector<std::vector<PageRange>> unreadable(units.size());
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t idx = 0; idx < units.size(); ++idx) {
+            auto& unit = units[idx];
+            auto& buffer = buffers[idx];
+
+            try {
+                MemoryMapper mapper { _process, unit._begin, unit._end, scanner.step(), scanner.size(), _cache_size };
+                mapper.skip(&_memory_regions[unit._region]._unreadable);
+                mapper.own(unit._limit);
+                mapper.map(_memory_regions[unit._region]);
+
+                auto callback = [&](auto&& value) {
+                    buffer.add_match(std::move(value));
+                };
+
+                while (mapper.next()) {
+                    if constexpr (ScansTail<typename std::decay<T>::type>::value) {
+                        scanner(mapper.address_begin(), mapper.begin(), mapper.end(), mapper.tail(), mapper.owned(), callback);
+                    } else {
+                        scanner(mapper.address_begin(), mapper.begin(), mapper.end(), callback);
+                    }
+                }
+                unreadable[idx] = mapper.unreadable();
+            } catch (...) {
+            }
+        }
+
+        for (size_t idx = 0; idx < units.size(); ++idx) {
+            merge(buffers[idx]);
+            record_unreadable(units[idx]._region, unreadable[idx]);
+        }
+
+        BufferPool::instance().trim();
     }
 
-    MATCH_TYPES(__BEGIN);
-#undef __BEGIN
+    /*
+        Scans for values that are not known yet. No match is created, the
+        scanned memory is recorded as compressed blocks instead, and the
+        next filter creates the matches of `type_bits` that pass it.
+    */
+    void scan_unknown(uint32_t type_bits, size_t step, uint32_t prot, bool exclude_file = false)
+    {
+        auto units = split_regions(prot, exclude_file, step, sizeof(uint64_t));
+        std::vector<SnapshotBlock> blocks(units.size());
+        std::vector<std::vector<PageRange>> unreadable(units.size());
 
-#define __END(t)                   \
-    auto t##_end()                 \
-    {                              \
-        return _matches_##t.end(); \
-    }
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t idx = 0; idx < units.size(); ++idx) {
+            auto& unit = units[idx];
 
-    MATCH_TYPES(__END);
-#undef __END
+            std::vector<uint8_t> buffer {};
+            buffer.reserve(unit._end.get() - unit._begin.get());
 
-#define __SIZE(t)                   \
-    size_t t##_size() const         \
-    {                               \
-        return _matches_##t.size(); \
-    }
+            try {
+                MemoryMapper mapper { _process, unit._begin, unit._end, 1, 1, _cache_size };
+                mapper.skip(&_memory_regions[unit._region]._unreadable);
+                mapper.map(_memory_regions[unit._region]);
 
-    MATCH_TYPES(__SIZE);
-#undef __SIZE
+                while (mapper.next()) {
+                    auto* begin = reinterpret_cast<uint8_t*>(mapper.begin());
+                    auto* end = reinterpret_cast<uint8_t*>(mapper.end());
+                    // the unreadable pages are left zero, filters skip them
+                    buffer.resize(mapper.address_begin().get() - unit._begin.get());
+                    buffer.insert(buffer.end(), begin, end);
+                }
+                unreadable[idx] = mapper.unreadable();
+            } catch (...) {
+            }
 
-#define __AT(t)                        \
-    auto t##_at(size_t index) const    \
-    {                                  \
-        return _matches_##t.at(index); \
-    }
+            if (not buffer.empty()) {
+                blocks[idx] = SnapshotBlock { unit._begin, unit._limit, buffer.data(), buffer.size() };
+            }
+        }
 
-    MATCH_TYPES(__AT);
-#undef __AT
+        for (size_t idx = 0; idx < units.size(); ++idx) {
+            record_unreadable(units[idx]._region, unreadable[idx]);
+        }
 
-    template <typename T>
-    void add_match(T&& match)
-    {
-#define __ADD_MATCH(t)                                \
-    if constexpr (std::is_same<T, Match##t>::value) { \
-        _matches_##t.emplace_back(std::move(match));  \
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [](const SnapshotBlock& block) { return block.empty(); }), blocks.end());
+
+        _snapshot._type_bits = type_bits;
+        _snapshot._step = step;
+        _snapshot._blocks = std::move(blocks);
+
+        BufferPool::instance().trim();
     }
 
-        MATCH_TYPES(__ADD_MATCH);
-#undef __ADD_MATCH
+    const PageSnapshot& snapshot() const
+    {
+        return _snapshot;
     }
 
-    template <typename T>
-    void scan(T&& scanner, uint32_t prot, bool exclude_file=false)
+    template <typename T, typename Predicate>
+    void filter_block(const SnapshotBlock& block, const uint8_t* old_data, const uint8_t* new_data, size_t size, const std::vector<PageRange>& unreadable, Predicate& predicate, MatchBuffer& buffer)
     {
-#pragma omp parallel for schedule(dynamic)
-        for (auto& region : _memory_regions) {
+        const size_t step = _snapshot._step;
+        const size_t limit = std::min(size, block.limit().get() - block.begin().get());
+        auto hole = find_page_range(unreadable, block.begin().get());
 
-            if ((region._prot & prot) != prot) {
-                continue;
-            }
+        for (size_t offset = 0; offset < limit and offset + sizeof(T) <= size; offset += step) {
+            auto addr = block.begin().get() + offset;
 
-#ifdef __ANDROID__
-            if (region._desc.find("anon:dalvik-") != std::string::npos) {
-                continue;
+            while (hole != unreadable.end() and hole->_end.get() <= addr) {
+                ++hole;
             }
-            if (region._file.find("/dev/kgsl") != std::string::npos) {
+            if (hole != unreadable.end() and hole->_begin.get() < addr + sizeof(T)) {
                 continue;
             }
-#endif
 
-            if (exclude_file and not region._android_bss and not region._file.empty()) {
-                continue;
+            T old_value, new_value;
+            memcpy(&old_value, old_data + offset, sizeof(T));
+            memcpy(&new_value, new_data + offset, sizeof(T));
+
+            if (predicate(old_value, new_value, addr)) {
+                buffer.add_match(typename GetMatchType<T>::type { VMAddress { addr }, std::move(new_value) });
             }
+        }
+    }
 
-            auto begin = region._begin;
-            auto end = region._end;
-            auto size = region.size();
+    /*
+        First filter after scan_unknown(). predicate(old_value, new_value,
+        address) decides for every position and requested type whether a
+        match is created. The snapshot is dropped afterwards.
+    */
+    template <typename Predicate>
+    void filter_snapshot(Predicate&& predicate)
+    {
+        auto& blocks = _snapshot._blocks;
+        std::vector<MatchBuffer> buffers(blocks.size(), MatchBuffer { _snapshot._step });
+        std::vector<std::vector<PageRange>> found(blocks.size());
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t idx = 0; idx < blocks.size(); ++idx) {
+            auto& block = blocks[idx];
+
+            std::vector<uint8_t> old_data(block.size());
+            std::vector<uint8_t> new_data {};
+            new_data.reserve(block.size());
+
+            // unreadable when the snapshot was taken or now
+            std::vector<PageRange> unreadable {};
+            auto region = region_index(block.begin().get());
+            if (region < _memory_regions.size()) {
+                unreadable = _memory_regions[region]._unreadable;
+            }
 
             try {
-                MemoryMapper mapper { _process, begin, end, scanner.step(), _cache_size };
+                block.decompress(old_data.data());
+
+                MemoryMapper mapper { _process, block.begin(), block.begin() + block.size(), 1, 1, _cache_size };
+                mapper.skip(&unreadable);
+                if (region < _memory_regions.size()) {
+                    mapper.map(_memory_regions[region]);
+                }
 
                 while (mapper.next()) {
-                    scanner(mapper.address_begin(), mapper.begin(), mapper.end(),
-                        [&](typename T::MatchType&& value) {
-#pragma omp critical
-                            add_match(std::move(value));
-                        });
+                    auto* begin = reinterpret_cast<uint8_t*>(mapper.begin());
+                    auto* end = reinterpret_cast<uint8_t*>(mapper.end());
+                    new_data.resize(mapper.address_begin().get() - block.begin().get());
+                    new_data.insert(new_data.end(), begin, end);
+                }
+
+                found[idx] = mapper.unreadable();
+                for (auto& range : found[idx]) {
+                    add_page_range(unreadable, range._begin, range._end);
                 }
             } catch (...) {
             }
+
+#define __FILTER_BLOCK(t)                                                                                                         \
+    if (_snapshot._type_bits & MatchTypeBit##t) {                                                                                 \
+        filter_block<type##t>(block, old_data.data(), new_data.data(), new_data.size(), unreadable, predicate, buffers[idx]); \
+    }
+
+            MATCH_TYPES_NUMBER(__FILTER_BLOCK);
+#undef __FILTER_BLOCK
+        }
+
+        for (size_t idx = 0; idx < blocks.size(); ++idx) {
+            merge(buffers[idx]);
+
+            auto region = region_index(blocks[idx].begin().get());
+            if (region < _memory_regions.size()) {
+                record_unreadable(region, found[idx]);
+            }
         }
+
+        _snapshot.clear();
+        BufferPool::instance().trim();
     }
 
-    template <typename Filter, typename M>
-    void filter(M& matches, const Filter& filter = {})
+    /*
+        Reads [addr, addr + size) into buffer around the pages known to be
+        unreadable, and past the pages that fail. The ranges left unread are
+        added to `missing`.
+    */
+    void read_around(uintptr_t addr, uint8_t* buffer, size_t size, const std::vector<PageRange>* unreadable, std::vector<PageRange>& missing)
+    {
+        const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+        const uintptr_t end = addr + size;
+
+        while (addr < end) {
+            auto piece_end = end;
+            if (unreadable != nullptr) {
+                auto hole = find_page_range(*unreadable, addr);
+                if (hole != unreadable->end() and hole->_begin.get() <= addr) {
+                    auto hole_end = std::min(hole->_end.get(), end);
+                    add_page_range(missing, VMAddress { addr }, VMAddress { hole_end });
+                    buffer += hole_end - addr;
+                    addr = hole_end;
+                    continue;
+                }
+                if (hole != unreadable->end() and hole->_begin.get() < end) {
+                    piece_end = hole->_begin.get();
+                }
+            }
+
+            auto nread = _process->read(VMAddress { addr }, buffer, piece_end - addr);
+            size_t valid = nread < 0 ? 0 : nread;
+            addr += valid;
+            buffer += valid;
+
+            if (addr < piece_end) {
+                // go on behind the page that failed
+                auto fail_end = std::min((addr / page_size + 1) * page_size, end);
+                add_page_range(missing, VMAddress { addr }, VMAddress { fail_end });
+                buffer += fail_end - addr;
+                addr = fail_end;
+            }
+        }
+    }
+
+    /*
+        Keeps the matches of a dense chunk the predicate accepts, one bitmap
+        word at a time. The memory the chunk covers is read around the
+        unreadable pages and replaces the copy in the chunk, since every kept
+        match takes the value just read.
+    */
+    template <typename Chunk, typename Predicate>
+    void compact_dense(Chunk& chunk, Predicate& predicate)
     {
-        typedef typename M::value_type MatchType;
-        typedef typename MatchType::type ValueType;
+        typedef typename Chunk::ValueType ValueType;
 
-        if (matches.empty()) {
-            return;
+        // only numbers have dense chunks
+        if constexpr (std::is_arithmetic<ValueType>::value) {
+            auto& bitmap = chunk.bitmap();
+            auto& bytes = chunk.bytes();
+            const auto step = chunk.step();
+
+            const auto begin = chunk.base();
+            const auto end = begin + bytes.size();
+
+            std::vector<uint8_t> buffer(bytes.size());
+            std::vector<PageRange> missing {};
+
+            const std::vector<PageRange>* unreadable = nullptr;
+            auto region = region_index(begin);
+            if (region < _memory_regions.size()) {
+                unreadable = &_memory_regions[region]._unreadable;
+            }
+
+            if (_skip_clean_pages) {
+                // only the dirty pages are read, the copy is still right for the others
+                memcpy(buffer.data(), bytes.data(), bytes.size());
+
+                for (auto iter = find_page_range(_dirty_pages, begin); iter != _dirty_pages.end() and iter->_begin.get() < end; ++iter) {
+                    auto from = std::max(iter->_begin.get(), begin);
+                    auto to = std::min(iter->_end.get(), end);
+                    read_around(from, buffer.data() + (from - begin), to - from, unreadable, missing);
+                }
+            } else {
+                read_around(begin, buffer.data(), buffer.size(), unreadable, missing);
+            }
+
+            auto hole = missing.cbegin();
+
+            for (size_t word = 0; word < bitmap.size(); ++word) {
+                uint64_t mask = bitmap[word];
+                uint64_t keep = 0;
+
+                while (mask) {
+                    auto bit = __builtin_ctzll(mask);
+                    mask &= mask - 1;
+
+                    auto offset = (word * 64 + bit) * step;
+                    while (hole != missing.cend() and hole->_end.get() <= begin + offset) {
+                        ++hole;
+                    }
+                    if (hole != missing.cend() and hole->_begin.get() < begin + offset + sizeof(ValueType)) {
+                        continue;
+                    }
+
+                    ValueType value;
+                    memcpy(&value, bytes.data() + offset, sizeof(ValueType));
+                    if (predicate(value, chunk.base() + offset, buffer.data() + offset)) {
+                        keep |= uint64_t(1) << bit;
+                    }
+                }
+                bitmap[word] = keep;
+            }
+
+            bytes.swap(buffer);
+            chunk.recount();
+            chunk.to_sparse();
         }
+    }
 
-        std::vector<struct iovec> remote {};
-        remote.reserve(matches.size());
-        size_t local_size = 0;
-        for (auto& match : matches) {
-            const auto size = sizeof(ValueType);
-            local_size += size;
-            remote.emplace_back(iovec { reinterpret_cast<void*>(match._addr.get()), size });
+    /*
+        Keeps the matches the predicate accepts. Every chunk is read and
+        compacted in place by its own task, so no second match store is
+        allocated.
+    */
+    template <typename M, typename Predicate>
+    void compact(M& matches, Predicate&& predicate)
+    {
+        typedef typename M::ValueType ValueType;
+
+        for (auto& chunk : matches.chunks()) {
+#pragma omp task default(shared)
+            {
+                if (chunk.dense()) {
+                    compact_dense(chunk, predicate);
+                } else {
+                    size_t keep = 0;
+                    size_t next = 0;
+
+                    auto accept = [&](size_t index, const void* ptr) {
+                        if (predicate(chunk.value(index), chunk.address(index), ptr)) {
+                            if (keep != index) {
+                                chunk.move(index, keep);
+                            }
+                            keep += 1;
+                        }
+                    };
+
+                    // matches on clean pages compare against the value they hold
+                    auto accept_clean = [&](size_t end) {
+                        for (; next < end; ++next) {
+                            ValueType value = chunk.value(next);
+                            accept(next, &value);
+                        }
+                    };
+
+                    MatchReader reader { _process, _memory_regions, _cache_size };
+                    reader.read(
+                        chunk, sizeof(ValueType),
+                        [&](size_t index, const void* ptr) {
+                            accept_clean(index);
+                            next = index + 1;
+
+                            if (ptr != nullptr) {
+                                accept(index, ptr);
+                            }
+                        },
+                        [&](size_t index) {
+                            auto addr = chunk.address(index);
+                            return page_dirty(addr, addr + sizeof(ValueType));
+                        });
+
+                    accept_clean(chunk.size());
+                    chunk.truncate(keep);
+                }
+            }
         }
-        std::vector<uint8_t> local_buffer;
-        local_buffer.resize(local_size);
-        struct iovec local_vec {
-            .iov_base = local_buffer.data(),
-            .iov_len = local_buffer.size()
-        };
-        _process->read(&local_vec, 1, remote.data(), remote.size());
+#pragma omp taskwait
 
-        std::vector<MatchType> new_matchs;
-        new_matchs.reserve(matches.size());
+        matches.reindex();
+    }
 
-        size_t offset = 0;
-        for (auto& match : matches) {
-            auto* ptr = local_buffer.data() + offset;
-            offset += sizeof(ValueType);
+    template <typename Filter, typename M>
+    void filter(M& matches, const Filter& filter = {})
+    {
+        typedef typename M::ValueType ValueType;
 
+        compact(matches, [&](ValueType& old_value, uintptr_t addr, const void* ptr) {
             ValueType value;
             memcpy(&value, ptr, sizeof(ValueType));
 
+            bool hit = false;
             if constexpr (sizeof(Filter) != 1) {
                 // filter_complex_expression
-                if (filter(match._value, value, match._addr.get())) {
-                    match._value = value;
-                    new_matchs.emplace_back(std::move(match));
-                }
+                hit = filter(old_value, value, addr);
             } else {
-                typename Filter::template Comparator<ValueType> comparator { match._value };
-
-                if (comparator(value)) {
-                    match._value = value;
-                    new_matchs.emplace_back(std::move(match));
-                }
+                typename Filter::template Comparator<ValueType> comparator { old_value };
+                hit = comparator(value);
             }
-        }
 
-        matches = std::move(new_matchs);
+            if (hit) {
+                old_value = value;
+            }
+            return hit;
+        });
     }
 
     template <typename Filter>
@@ -377,60 +1486,75 @@ public:
     {
         static_assert(sizeof(Filter) == 1, "see filter_complex_expression");
 
+        begin_dirty_pass();
+
+        if (not _snapshot.empty()) {
+            filter_snapshot([](auto old_value, auto new_value, uintptr_t) {
+                typedef decltype(old_value) T;
+                if constexpr (IsSuitableFilter<Filter, T>::value) {
+                    typename Filter::template Comparator<T> comparator { old_value };
+                    return bool(comparator(new_value));
+                }
+                return false;
+            });
+            return;
+        }
+
 #define __FILTER(t)                                           \
     if constexpr (IsSuitableFilter<Filter, type##t>::value) { \
+        _Pragma("omp task")                                   \
         filter<Filter>(_matches_##t);                         \
     }
 
-        MATCH_TYPES(__FILTER);
+#pragma omp parallel
+#pragma omp single
+        {
+            MATCH_TYPES(__FILTER);
+        }
 #undef __FILTER
     }
 
     template <typename Filter, typename M>
     void filter(M& matches, uintptr_t constant1, uintptr_t constant2)
     {
-        typedef typename M::value_type MatchType;
-        typedef typename MatchType::type ValueType;
-
-        if (matches.empty()) {
-            return;
-        }
+        typedef typename M::ValueType ValueType;
 
-        std::vector<struct iovec> remote {};
-        std::vector<struct iovec> local {};
+        auto comparator = Filter::template create<ValueType>(constant1, constant2);
 
-        remote.reserve(matches.size());
-        local.reserve(matches.size());
-
-        for (auto& match : matches) {
-            remote.emplace_back(iovec { reinterpret_cast<void*>(match._addr.get()), sizeof(match._value) });
-            local.emplace_back(iovec { &match._value, sizeof(match._value) });
-        }
-
-        _process->read(local.data(), local.size(), remote.data(), remote.size());
-
-        std::vector<MatchType> new_matchs;
-        new_matchs.reserve(matches.size());
-
-        for (auto& match : matches) {
-            auto comparator = Filter::template create<ValueType>(constant1, constant2);
-
-            if (comparator(match._value)) {
-                new_matchs.emplace_back(std::move(match));
-            }
-        }
-        matches = std::move(new_matchs);
+        compact(matches, [&](ValueType& value, uintptr_t addr, const void* ptr) {
+            memcpy(&value, ptr, sizeof(ValueType));
+            return comparator(value);
+        });
     }
 
     template <typename Filter>
     void filter(uintptr_t constant1, uintptr_t constant2)
     {
+        begin_dirty_pass();
+
+        if (not _snapshot.empty()) {
+            filter_snapshot([=](auto old_value, auto new_value, uintptr_t) {
+                typedef decltype(old_value) T;
+                if constexpr (IsSuitableFilter<Filter, T>::value) {
+                    auto comparator = Filter::template create<T>(constant1, constant2);
+                    return bool(comparator(new_value));
+                }
+                return false;
+            });
+            return;
+        }
+
 #define __FILTER(t)                                           \
     if constexpr (IsSuitableFilter<Filter, type##t>::value) { \
+        _Pragma("omp task")                                   \
         filter<Filter>(_matches_##t, constant1, constant2);   \
     }
 
-        MATCH_TYPES(__FILTER);
+#pragma omp parallel
+#pragma omp single
+        {
+            MATCH_TYPES(__FILTER);
+        }
 #undef __FILTER
     }
 
@@ -438,43 +1562,72 @@ public:
     void filter_complex_expression(Code& signed_code, Code& unsigned_code)
     {
         static_assert(sizeof(Code) != 1, "see filter_complex_expression");
-#define __FILTER(t) \
+
+        begin_dirty_pass();
+
+        if (not _snapshot.empty()) {
+            filter_snapshot([&](auto old_value, auto new_value, uintptr_t addr) {
+                typedef decltype(old_value) T;
+                if constexpr (std::is_integral<T>::value) {
+                    auto& code = std::is_signed<T>::value ? signed_code : unsigned_code;
+                    return bool(code(old_value, new_value, addr));
+                }
+                return false;
+            });
+            return;
+        }
+
+#define __FILTER(t)    \
+    _Pragma("omp task") \
     filter<Code>(_matches_##t, std::is_signed<type##t>::value ? signed_code : unsigned_code);
 
-        MATCH_TYPES_INTEGER(__FILTER);
+#pragma omp parallel
+#pragma omp single
+        {
+            MATCH_TYPES_INTEGER(__FILTER);
+        }
 #undef __FILTER
     }
 
     template <typename M>
     void update_matches(M& matches)
     {
-        typedef typename M::value_type MatchType;
-        typedef typename MatchType::type ValueType;
-
-        if (matches.empty()) {
-            return;
-        }
-
-        std::vector<struct iovec> remote {};
-        std::vector<struct iovec> local {};
-
-        remote.reserve(matches.size());
-        local.reserve(matches.size());
-
-        for (auto& match : matches) {
-            remote.emplace_back(iovec { reinterpret_cast<void*>(match._addr.get()), sizeof(match._value) });
-            local.emplace_back(iovec { &match._value, sizeof(match._value) });
+        typedef typename M::ValueType ValueType;
+
+        for (auto& chunk : matches.chunks()) {
+#pragma omp task default(shared)
+            {
+                if (chunk.dense()) {
+                    // the pages that can not be read keep the values read before
+                    auto& bytes = chunk.bytes();
+                    std::vector<PageRange> missing {};
+                    auto region = region_index(chunk.base());
+                    read_around(chunk.base(), bytes.data(), bytes.size(),
+                        region < _memory_regions.size() ? &_memory_regions[region]._unreadable : nullptr, missing);
+                } else {
+                    MatchReader reader { _process, _memory_regions, _cache_size };
+                    reader.read(chunk, sizeof(ValueType), [&](size_t index, const void* ptr) {
+                        if (ptr != nullptr) {
+                            memcpy(&chunk.value(index), ptr, sizeof(ValueType));
+                        }
+                    });
+                }
+            }
         }
-
-        _process->read(local.data(), local.size(), remote.data(), remote.size());
+#pragma omp taskwait
     }
 
     void update_matches()
     {
-#define __UPDATE(t) \
+#define __UPDATE(t)    \
+    _Pragma("omp task") \
     update_matches(_matches_##t);
 
-        MATCH_TYPES_INTEGER(__UPDATE);
+#pragma omp parallel
+#pragma omp single
+        {
+            MATCH_TYPES_INTEGER(__UPDATE);
+        }
 #undef __UPDATE
     }
 };
@@ -501,27 +1654,46 @@ public:
 
     constexpr size_t step() const { return _step; }
 
+    constexpr size_t size() const { return sizeof(ValueType); }
+
     template <typename Callback>
     void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, Callback&& callback)
     {
         // Copy to stack
         const auto step = this->step();
         const auto comparator = _comparator;
-#if 0
-        if (std::is_same<Comparator, ComparatorEqual<uint8_t>>::value and this->step() == sizeof(Type)) {
-            // TODO memchr or SIMD
-#if SIMDJSON_IS_ARM64
-            using namespace simdjson::arm64;
-            simd8<uint8_t> v0 { reinterpret_cast<uint8_t*>(buffer) };
-            simd8<uint8_t> v1 { reinterpret_cast<uint8_t*>(buffer) + sizeof(v0) };
-            uint64_t mask = simd8x64<bool>(v0 == _value, v1 == _value, v0 == _value, v1 == _value).to_bitmask();
-            if (UNLIKELY(mask > 0)) { }
-#endif
-        }
-#endif
+
         if (step == sizeof(ValueType)) {
             auto begin = reinterpret_cast<uintptr_t>(buffer_begin);
             auto end = reinterpret_cast<uintptr_t>(buffer_end);
+            auto count = (end - begin) / sizeof(ValueType);
+            auto level = simd::cpu_level();
+
+            // 64 elements per mask, 64 masks per kernel call
+            constexpr size_t batch_blocks = 64;
+            uint64_t masks[batch_blocks];
+
+            while (count >= simd::kBlockSize) {
+                auto blocks = std::min(count / simd::kBlockSize, batch_blocks);
+                simd::compare(level, comparator, reinterpret_cast<void*>(begin), blocks, masks);
+
+                for (size_t block = 0; block < blocks; ++block) {
+                    auto mask = masks[block];
+                    while (UNLIKELY(mask)) {
+                        auto offset = (block * simd::kBlockSize + __builtin_ctzll(mask)) * sizeof(ValueType);
+                        mask &= mask - 1;
+
+                        ValueType value;
+                        memcpy(&value, reinterpret_cast<void*>(begin + offset), sizeof(ValueType));
+                        auto address = addr_begin + ((begin + offset) - reinterpret_cast<uintptr_t>(buffer_begin));
+                        callback(MatchType(std::move(address), std::move(value)));
+                    }
+                }
+
+                begin += blocks * simd::kBlockSize * sizeof(ValueType);
+                count -= blocks * simd::kBlockSize;
+            }
+
             for (uintptr_t iter = begin; iter != end; iter += step) {
                 auto value = *reinterpret_cast<ValueType*>(iter);
                 if constexpr (std::is_floating_point<ValueType>::value) {
@@ -575,6 +1747,8 @@ public:
 
     size_t step() const { return _step; }
 
+    size_t size() const { return sizeof(ValueType); }
+
     template <typename Callback>
     void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, Callback&& callback)
     {
@@ -608,15 +1782,19 @@ public:
     {
     }
 
-    size_t step() const { return _bytes.size(); }
+    // memmem matches at any byte offset
+    size_t step() const { return 1; }
+
+    size_t size() const { return _bytes.size(); }
 
     template <typename Callback>
     void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, Callback&& callback)
     {
         auto begin = reinterpret_cast<uint8_t*>(buffer_begin);
-        auto end = reinterpret_cast<uint8_t*>(buffer_end);
+        // the bytes of the last position run past buffer_end
+        auto end = reinterpret_cast<uint8_t*>(buffer_end) + _bytes.size() - 1;
 
-        if ((end - begin) < _bytes.size()) {
+        if (buffer_begin == buffer_end) {
             return;
         }
 
@@ -634,6 +1812,163 @@ public:
     }
 };
 
+/*
+    Pointer-sized values that point into one of the indexed regions. Most
+    words are small integers or zero, so the bounds of the index reject
+    them before the binary search.
+*/
+class ScanPointer {
+    const RegionIndex& _targets;
+    size_t _step;
+
+public:
+    typedef typename GetMatchType<uintptr_t>::type MatchType;
+
+    ScanPointer(const RegionIndex& targets, size_t step)
+        : _targets(targets)
+        , _step(step)
+    {
+        assert(_step > 0);
+    }
+
+    size_t step() const { return _step; }
+
+    size_t size() const { return sizeof(uintptr_t); }
+
+    template <typename Callback>
+    void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, Callback&& callback)
+    {
+        const auto step = _step;
+        const auto lower = _targets.lower();
+        const auto upper = _targets.upper();
+
+        auto begin = reinterpret_cast<uintptr_t>(buffer_begin);
+        auto end = reinterpret_cast<uintptr_t>(buffer_end);
+        for (uintptr_t iter = begin; iter != end; iter += step) {
+            uintptr_t value;
+            memcpy(&value, reinterpret_cast<void*>(iter), sizeof(value));
+            if (LIKELY(value < lower or value >= upper)) {
+                continue;
+            }
+            if (_targets.find(value) != RegionIndex::npos) {
+                auto address = addr_begin + (iter - begin);
+                callback(MatchType(std::move(address), std::move(value)));
+            }
+        }
+    }
+};
+
+struct MatchSink {
+    virtual ~MatchSink() = default;
+
+#define __ADD(t) virtual void add(Match##t&& match) = 0;
+    MATCH_TYPES(__ADD);
+#undef __ADD
+};
+
+/*
+    Runs several scanners with the same step against each chunk, so a
+    multi-type scan reads the target memory only once. The chunk positions
+    are counted with the widest size, the narrower scanners also take the
+    positions of the tail where only they fit.
+*/
+class ScanMultiple {
+    struct Scanner {
+        virtual ~Scanner() = default;
+        virtual size_t size() const = 0;
+        virtual void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, MatchSink& sink) = 0;
+    };
+
+    template <typename T>
+    struct ScannerImpl : public Scanner {
+        T _scanner;
+
+        ScannerImpl(T&& scanner)
+            : _scanner(std::move(scanner))
+        {
+        }
+
+        size_t size() const override
+        {
+            return _scanner.size();
+        }
+
+        void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, MatchSink& sink) override
+        {
+            _scanner(addr_begin, buffer_begin, buffer_end, [&](auto&& value) {
+                sink.add(std::move(value));
+            });
+        }
+    };
+
+    template <typename Callback>
+    struct MatchSinkImpl : public MatchSink {
+        Callback& _callback;
+
+        MatchSinkImpl(Callback& callback)
+            : _callback(callback)
+        {
+        }
+
+#define __ADD(t)                                \
+    void add(Match##t&& match) override         \
+    {                                           \
+        _callback(std::move(match));            \
+    }
+        MATCH_TYPES(__ADD);
+#undef __ADD
+    };
+
+    std::vector<std::unique_ptr<Scanner>> _scanners {};
+    size_t _step;
+    size_t _size { 0 };
+
+public:
+    ScanMultiple(size_t step)
+        : _step(step)
+    {
+        assert(_step > 0);
+    }
+
+    size_t step() const { return _step; }
+
+    size_t size() const { return _size; }
+
+    bool empty() const { return _scanners.empty(); }
+
+    template <typename T>
+    void add(T&& scanner)
+    {
+        assert(scanner.step() == _step);
+        _size = std::max(_size, scanner.size());
+        _scanners.emplace_back(new ScannerImpl<typename std::decay<T>::type>(std::move(scanner)));
+    }
+
+    template <typename Callback>
+    void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, void* buffer_tail, void* buffer_owned, Callback&& callback)
+    {
+        MatchSinkImpl<Callback> sink { callback };
+        auto end = reinterpret_cast<uintptr_t>(buffer_end);
+        auto tail = reinterpret_cast<uintptr_t>(buffer_tail);
+        // the positions behind `owned` are scanned by the next unit
+        auto owned = (reinterpret_cast<uintptr_t>(buffer_owned) - end + _step - 1) / _step;
+        for (auto& scanner : _scanners) {
+            auto size = scanner->size();
+            auto scanner_end = end;
+            if (tail - end >= size) {
+                scanner_end += std::min((tail - end - size) / _step + 1, owned) * _step;
+            }
+            (*scanner)(addr_begin, buffer_begin, reinterpret_cast<void*>(scanner_end), sink);
+        }
+    }
+
+    template <typename Callback>
+    void operator()(VMAddress addr_begin, void* buffer_begin, void* buffer_end, Callback&& callback)
+    {
+        (*this)(addr_begin, buffer_begin, buffer_end, buffer_end, buffer_end, std::forward<Callback>(callback));
+    }
+};
+
 } // namespace mypower
 
 #endif
@@ -0,0 +1,247 @@
+/*
+Copyright (C) 2023 pom@vro.life
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef __simd_hpp__
+#define __simd_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace mypower {
+namespace simd {
+
+/*
+    Elements are compared in blocks of 64, one bit per element. The
+    comparator is inlined into a kernel compiled for each instruction set,
+    so the compiler vectorizes the compare for every Comparator and every
+    width, and the hit bytes are packed into the block mask with the
+    instruction set's movemask.
+*/
+constexpr size_t kBlockSize = 64;
+
+enum class Level {
+    Generic,
+    SSE2,
+    AVX2,
+    AVX512,
+    NEON,
+};
+
+inline const char* level_to_string(Level level)
+{
+    switch (level) {
+    case Level::SSE2:
+        return "SSE2";
+    case Level::AVX2:
+        return "AVX2";
+    case Level::AVX512:
+        return "AVX512";
+    case Level::NEON:
+        return "NEON";
+    default:
+        return "Generic";
+    }
+}
+
+inline bool level_supported(Level level)
+{
+    switch (level) {
+    case Level::Generic:
+        return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case Level::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case Level::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case Level::AVX512:
+        return __builtin_cpu_supports("avx512bw");
+#elif defined(__aarch64__)
+    case Level::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+inline Level cpu_level()
+{
+    static const Level level = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (level_supported(Level::AVX512)) {
+            return Level::AVX512;
+        }
+        if (level_supported(Level::AVX2)) {
+            return Level::AVX2;
+        }
+        if (level_supported(Level::SSE2)) {
+            return Level::SSE2;
+        }
+#elif defined(__aarch64__)
+        return Level::NEON;
+#endif
+        return Level::Generic;
+    }();
+    return level;
+}
+
+template <typename Comparator, typename T>
+inline bool compare_one(const Comparator& comparator, const T& value)
+{
+    if constexpr (std::is_floating_point<T>::value) {
+        // NaN never matches
+        return comparator(value) & (value == value);
+    } else {
+        return comparator(value);
+    }
+}
+
+inline uint64_t to_bitmask_generic(const uint8_t* hits)
+{
+    uint64_t mask = 0;
+    for (size_t idx = 0; idx < kBlockSize; ++idx) {
+        mask |= static_cast<uint64_t>(hits[idx]) << idx;
+    }
+    return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2"))) inline uint64_t to_bitmask_sse2(const uint8_t* hits)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t mask = 0;
+    for (size_t idx = 0; idx < 4; ++idx) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hits + idx * 16));
+        v = _mm_sub_epi8(zero, v); // 1 -> 0xFF
+        mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(v))) << (idx * 16);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) inline uint64_t to_bitmask_avx2(const uint8_t* hits)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    auto lo = _mm256_sub_epi8(zero, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hits)));
+    auto hi = _mm256_sub_epi8(zero, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hits + 32)));
+    return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(lo)))
+        | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi))) << 32);
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline uint64_t to_bitmask_avx512(const uint8_t* hits)
+{
+    auto v = _mm512_loadu_si512(hits);
+    return _mm512_test_epi8_mask(v, v);
+}
+
+#elif defined(__aarch64__)
+
+inline uint64_t to_bitmask_neon(const uint8_t* hits)
+{
+    // simdjson simd8x64<bool>::to_bitmask
+    const uint8x16_t bit_mask = {
+        0x01, 0x02, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80,
+        0x01, 0x02, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80
+    };
+    auto v0 = vandq_u8(vtstq_u8(vld1q_u8(hits), vld1q_u8(hits)), bit_mask);
+    auto v1 = vandq_u8(vtstq_u8(vld1q_u8(hits + 16), vld1q_u8(hits + 16)), bit_mask);
+    auto v2 = vandq_u8(vtstq_u8(vld1q_u8(hits + 32), vld1q_u8(hits + 32)), bit_mask);
+    auto v3 = vandq_u8(vtstq_u8(vld1q_u8(hits + 48), vld1q_u8(hits + 48)), bit_mask);
+    auto sum0 = vpaddq_u8(v0, v1);
+    auto sum1 = vpaddq_u8(v2, v3);
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+#endif
+
+/*
+    masks[idx] bit N is set when element (idx * 64 + N) of data matches
+*/
+#define MYPOWER_SIMD_KERNEL(NAME, ATTRIBUTE, TO_BITMASK)                                         \
+    template <typename Comparator>                                                               \
+    ATTRIBUTE void NAME(const Comparator& comparator, const void* data, size_t blocks, uint64_t* masks) \
+    {                                                                                            \
+        typedef typename Comparator::Type T;                                                     \
+        const auto* ptr = reinterpret_cast<const uint8_t*>(data);                                \
+        for (size_t block = 0; block < blocks; ++block) {                                        \
+            T values[kBlockSize];                                                                \
+            uint8_t hits[kBlockSize];                                                            \
+            memcpy(values, ptr + block * sizeof(values), sizeof(values));                        \
+            for (size_t idx = 0; idx < kBlockSize; ++idx) {                                      \
+                hits[idx] = compare_one(comparator, values[idx]);                                \
+            }                                                                                    \
+            masks[block] = TO_BITMASK(hits);                                                     \
+        }                                                                                        \
+    }
+
+MYPOWER_SIMD_KERNEL(compare_generic, , to_bitmask_generic);
+
+#if defined(__x86_64__) || defined(__i386__)
+MYPOWER_SIMD_KERNEL(compare_sse2, __attribute__((target("sse2"))), to_bitmask_sse2);
+MYPOWER_SIMD_KERNEL(compare_avx2, __attribute__((target("avx2"))), to_bitmask_avx2);
+MYPOWER_SIMD_KERNEL(compare_avx512, __attribute__((target("avx512f,avx512bw"))), to_bitmask_avx512);
+#elif defined(__aarch64__)
+MYPOWER_SIMD_KERNEL(compare_neon, , to_bitmask_neon);
+#endif
+
+#undef MYPOWER_SIMD_KERNEL
+
+template <typename Comparator>
+inline void compare(Level level, const Comparator& comparator, const void* data, size_t blocks, uint64_t* masks)
+{
+    switch (level) {
+#if defined(__x86_64__) || defined(__i386__)
+    case Level::AVX512:
+        compare_avx512(comparator, data, blocks, masks);
+        return;
+    case Level::AVX2:
+        compare_avx2(comparator, data, blocks, masks);
+        return;
+    case Level::SSE2:
+        compare_sse2(comparator, data, blocks, masks);
+        return;
+#elif defined(__aarch64__)
+    case Level::NEON:
+        compare_neon(comparator, data, blocks, masks);
+        return;
+#endif
+    default:
+        compare_generic(comparator, data, blocks, masks);
+        return;
+    }
+}
+
+template <typename Comparator>
+inline void compare(const Comparator& comparator, const void* data, size_t blocks, uint64_t* masks)
+{
+    compare(cpu_level(), comparator, data, blocks, masks);
+}
+
+} // namespace simd
+} // namespace mypower
+
+#endif
@@ -14,78 +14,229 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <regex>
+#include <iomanip>
 #include <streambuf>
 #include <string>
 
 #include "vmmap.hpp"
 
-#define REGEX R"(([0-9a-fA-F]+)-([0-9a-fA-F]+)\s+([rwxps-]{4})\s+([0-9a-f]+)\s+([0-9a-fA-F]+):([0-9a-fA-F]+)\s+(\d+)[ \t\r]*(.*)\n)"
-
 using namespace std::string_literals;
 namespace fs = std::filesystem;
 
 namespace mypower {
-std::vector<VMRegion> snapshot_impl(const std::string& s)
+
+static int digit_value(char ch, int base)
+{
+    int value = 16;
+    if (ch >= '0' and ch <= '9') {
+        value = ch - '0';
+    } else if (ch >= 'a' and ch <= 'f') {
+        value = ch - 'a' + 10;
+    } else if (ch >= 'A' and ch <= 'F') {
+        value = ch - 'A' + 10;
+    }
+    return value < base ? value : -1;
+}
+
+// at least one digit
+static bool parse_number(const char*& ptr, const char* end, int base, uint64_t& value)
+{
+    const char* begin = ptr;
+    value = 0;
+    for (int digit; ptr != end and (digit = digit_value(*ptr, base)) != -1; ++ptr) {
+        value = value * base + digit;
+    }
+    return ptr != begin;
+}
+
+// at least one blank
+static bool skip_blank(const char*& ptr, const char* end)
+{
+    const char* begin = ptr;
+    while (ptr != end and (*ptr == ' ' or *ptr == '\t' or *ptr == '\r')) {
+        ++ptr;
+    }
+    return ptr != begin;
+}
+
+static bool skip_char(const char*& ptr, const char* end, char ch)
+{
+    if (ptr == end or *ptr != ch) {
+        return false;
+    }
+    ++ptr;
+    return true;
+}
+
+/*
+    One line of /proc/pid/maps, without the newline:
+    begin-end perms offset major:minor inode [name]
+*/
+static bool parse_line(const char* ptr, const char* end, VMRegion& region)
 {
-    std::regex exp(REGEX, std::regex_constants::ECMAScript | std::regex_constants::icase);
+    uint64_t begin, end_addr, offset, major, minor, inode;
+
+    if (not(parse_number(ptr, end, 16, begin) and skip_char(ptr, end, '-') and parse_number(ptr, end, 16, end_addr) and skip_blank(ptr, end))) {
+        return false;
+    }
+
+    if (end - ptr < 4) {
+        return false;
+    }
+    const char* perms = ptr;
+    for (int idx = 0; idx < 4; ++idx) {
+        if (perms[idx] == '\0' or strchr("rwxps-", perms[idx]) == nullptr) {
+            return false;
+        }
+    }
+    ptr += 4;
 
-    auto begin = std::sregex_iterator(s.begin(), s.end(), exp);
+    if (not(skip_blank(ptr, end) and parse_number(ptr, end, 16, offset) and skip_blank(ptr, end)
+            and parse_number(ptr, end, 16, major) and skip_char(ptr, end, ':') and parse_number(ptr, end, 16, minor)
+            and skip_blank(ptr, end) and parse_number(ptr, end, 10, inode))) {
+        return false;
+    }
+    skip_blank(ptr, end);
+
+    region._begin = VMAddress { static_cast<uintptr_t>(begin) };
+    region._end = VMAddress { static_cast<uintptr_t>(end_addr) };
+    region._prot = 0;
+
+    if (perms[0] != '-')
+        region._prot |= kRegionFlagRead;
+    if (perms[1] != '-')
+        region._prot |= kRegionFlagWrite;
+    if (perms[2] != '-')
+        region._prot |= kRegionFlagExec;
+
+    region._shared = perms[3] == 's';
+
+    region._offset = offset;
+    region._major = major;
+    region._minor = minor;
+    region._inode = inode;
 
-    auto end = std::sregex_iterator();
+    if (ptr != end) {
+        if (*ptr == '/') {
+            auto space = static_cast<const char*>(memchr(ptr, ' ', end - ptr));
+            if (space == nullptr) {
+                region._file.assign(ptr, end);
+            } else {
+                region._file.assign(ptr, space);
+                region._desc.assign(space, end);
+            }
+        } else {
+            region._desc.assign(ptr, end);
+        }
+    }
+    return true;
+}
 
+/*
+    Single pass over the text, lines that do not parse are skipped. Apart
+    from the region list only the names are allocated.
+*/
+std::vector<VMRegion> snapshot_impl(const char* ptr, const char* end)
+{
     std::vector<VMRegion> regions;
+    regions.reserve(std::count(ptr, end, '\n'));
 
-    for (auto iter = begin; iter != end; ++iter) {
-        auto& match = *iter;
+    while (ptr != end) {
+        auto eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+        if (eol == nullptr) {
+            break;
+        }
 
         VMRegion region;
-        region._begin = VMAddress { std::stoul(match[1], 0, 16) };
-        region._end = VMAddress { std::stoul(match[2], 0, 16) };
-        region._prot = 0;
-
-        const std::string perms = match[3].str();
-        if (perms[0] != '-')
-            region._prot |= kRegionFlagRead;
-        if (perms[1] != '-')
-            region._prot |= kRegionFlagWrite;
-        if (perms[2] != '-')
-            region._prot |= kRegionFlagExec;
-
-        region._shared = perms[3] == 's';
-
-        region._offset = std::stoull(match[4], 0, 16);
-
-        region._major = std::stoull(match[5], 0, 16);
-        region._minor = std::stoull(match[6], 0, 16);
-        region._inode = std::stoull(match[7], 0, 10);
-
-        auto s = match[8].str();
-
-        if (s.size()) {
-            if (s[0] == '/') {
-                auto w = s.find(' ');
-                if (w == std::string::npos) {
-                    region._file = s;
-                } else {
-                    region._file = s.substr(0, w);
-                    region._desc = s.substr(w);
+        if (parse_line(ptr, eol, region)) {
+            if (not regions.empty()) {
+                auto& last = regions.back();
+                if (last._end == region._begin and region._desc == "[anon:.bss]") {
+                    region._file = last._file;
+                    region._android_bss = true;
                 }
-            } else {
-                region._desc = s;
             }
+            regions.emplace_back(std::move(region));
+        }
+        ptr = eol + 1;
+    }
+    return regions;
+}
+
+bool same_mapping(const VMRegion& before, const VMRegion& after)
+{
+    if (before._inode != after._inode or before._major != after._major or before._minor != after._minor or before._shared != after._shared) {
+        return false;
+    }
+    if (before._inode == 0) {
+        // anonymous memory has no offset, a name like [heap] or [anon:...] tells it apart
+        return before._file == after._file and before._desc == after._desc;
+    }
+    return before._file == after._file
+        and before._begin.get() - before._offset == after._begin.get() - after._offset;
+}
+
+/*
+    Sweeps both lists at once, every boundary of either list starts a new
+    piece. A piece mapped only before, or mapped differently after, is
+    removed, and the other way round it is added.
+*/
+RegionDiff diff_regions(const VMRegion::ListType& before, const VMRegion::ListType& after)
+{
+    RegionDiff diff {};
+
+    auto append = [](std::vector<PageRange>& ranges, uintptr_t begin, uintptr_t end) {
+        if (not ranges.empty() and ranges.back()._end.get() == begin) {
+            ranges.back()._end = VMAddress { end };
+        } else {
+            ranges.push_back(PageRange { VMAddress { begin }, VMAddress { end } });
         }
+    };
+
+    size_t old_idx = 0;
+    size_t new_idx = 0;
+    uintptr_t addr = 0;
 
-        if (not regions.empty() and regions.at(regions.size() -1)._end == region._begin and region._desc == "[anon:.bss]") {
-            region._file = regions.rbegin()->_file;
-            region._android_bss = true;
+    for (;;) {
+        while (old_idx < before.size() and before[old_idx]._end.get() <= addr) {
+            ++old_idx;
+        }
+        while (new_idx < after.size() and after[new_idx]._end.get() <= addr) {
+            ++new_idx;
+        }
+        if (old_idx == before.size() and new_idx == after.size()) {
+            break;
+        }
+
+        const VMRegion* old_region = old_idx < before.size() and before[old_idx]._begin.get() <= addr ? &before[old_idx] : nullptr;
+        const VMRegion* new_region = new_idx < after.size() and after[new_idx]._begin.get() <= addr ? &after[new_idx] : nullptr;
+
+        uintptr_t next = UINTPTR_MAX;
+        if (old_idx < before.size()) {
+            next = std::min(next, old_region ? old_region->_end.get() : before[old_idx]._begin.get());
+        }
+        if (new_idx < after.size()) {
+            next = std::min(next, new_region ? new_region->_end.get() : after[new_idx]._begin.get());
         }
 
-        regions.emplace_back(std::move(region));
+        bool same = old_region and new_region and same_mapping(*old_region, *new_region);
+        if (old_region and not same) {
+            append(diff._removed, addr, next);
+        }
+        if (new_region and not same) {
+            append(diff._added, addr, next);
+        }
+        addr = next;
     }
-    return regions;
+    return diff;
 }
 
 void VMRegion::string(std::ostringstream& oss)
@@ -130,16 +281,36 @@ void VMRegion::string(std::ostringstream& oss)
 
 std::vector<VMRegion> VMRegion::snapshot(std::istream& is)
 {
-    return snapshot_impl(std::string { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() });
+    std::string text { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+    return snapshot_impl(text.data(), text.data() + text.size());
 }
 
 std::vector<VMRegion> VMRegion::snapshot(const fs::path& maps)
 {
-    std::ifstream ifs(maps);
-    if (!ifs.is_open()) {
+    int fd = ::open(maps.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
         return {};
     }
-    return snapshot(ifs);
+
+    // procfs files report no size, the buffer is kept for the next call
+    thread_local std::vector<char> buffer(64 * 1024);
+    size_t size = 0;
+    for (;;) {
+        if (size == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        auto nread = ::read(fd, buffer.data() + size, buffer.size() - size);
+        if (nread < 0 and errno == EINTR) {
+            continue;
+        }
+        if (nread <= 0) {
+            break;
+        }
+        size += nread;
+    }
+    ::close(fd);
+
+    return snapshot_impl(buffer.data(), buffer.data() + size);
 }
 
 std::vector<VMRegion> VMRegion::snapshot(pid_t pid)
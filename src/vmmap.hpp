@@ -17,6 +17,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef __vmmap_hpp__
 #define __vmmap_hpp__
 
+#include <algorithm>
 #include <filesystem>
 #include <sstream>
 #include <string>
@@ -135,6 +136,33 @@ public:
     }
 };
 
+struct PageRange {
+    VMAddress _begin;
+    VMAddress _end;
+};
+
+// the first of the sorted ranges that ends after addr
+inline std::vector<PageRange>::const_iterator find_page_range(const std::vector<PageRange>& ranges, uintptr_t addr)
+{
+    return std::upper_bound(ranges.begin(), ranges.end(), addr,
+        [](uintptr_t addr, const PageRange& range) { return addr < range._end.get(); });
+}
+
+// adds [begin, end) to the sorted ranges, merging the ranges it touches
+inline void add_page_range(std::vector<PageRange>& ranges, VMAddress begin, VMAddress end)
+{
+    auto iter = ranges.begin();
+    while (iter != ranges.end() and iter->_end < begin) {
+        ++iter;
+    }
+    while (iter != ranges.end() and iter->_begin <= end) {
+        begin = std::min(begin, iter->_begin);
+        end = std::max(end, iter->_end);
+        iter = ranges.erase(iter);
+    }
+    ranges.insert(iter, PageRange { begin, end });
+}
+
 struct VMRegion {
     VMAddress _begin { 0 };
     VMAddress _end { 0 };
@@ -151,6 +179,9 @@ struct VMRegion {
     bool _deleted { false };
     bool _android_bss{false};
 
+    // pages that failed to read, sorted
+    std::vector<PageRange> _unreadable {};
+
     VMRegion() = default;
 
     uintptr_t size() const
@@ -158,6 +189,11 @@ struct VMRegion {
         return _end.get() - _begin.get();
     }
 
+    void add_unreadable(VMAddress begin, VMAddress end)
+    {
+        add_page_range(_unreadable, begin, end);
+    }
+
     void string(std::ostringstream& oss);
 
     typedef std::vector<VMRegion> ListType;
@@ -167,6 +203,83 @@ struct VMRegion {
     static ListType snapshot(pid_t pid);
 };
 
+/*
+    Address ranges that changed between two region lists. A range that is
+    mapped in both lists, but to another file or another offset of the
+    file, is both removed and added.
+*/
+struct RegionDiff {
+    std::vector<PageRange> _removed {};
+    std::vector<PageRange> _added {};
+
+    bool empty() const { return _removed.empty() and _added.empty(); }
+};
+
+// both lists sorted by address, as read from maps
+RegionDiff diff_regions(const VMRegion::ListType& before, const VMRegion::ListType& after);
+
+// whether the bytes at the same address of both regions are the same mapping
+bool same_mapping(const VMRegion& before, const VMRegion& after);
+
+/*
+    Sorted bounds of a region list for "which region holds this address"
+    lookups. Build it once per list, it does not follow later changes of
+    the list. Only the regions with all of `prot` are indexed.
+*/
+class RegionIndex {
+    struct Entry {
+        uintptr_t _begin;
+        uintptr_t _end;
+        size_t _index;
+    };
+
+    std::vector<Entry> _entries {};
+    uintptr_t _upper { 0 };
+
+public:
+    static constexpr size_t npos = size_t(-1);
+
+    RegionIndex() = default;
+
+    explicit RegionIndex(const VMRegion::ListType& regions, uint32_t prot = kRegionFlagNone)
+    {
+        _entries.reserve(regions.size());
+        for (size_t idx = 0; idx < regions.size(); ++idx) {
+            auto& region = regions[idx];
+            if ((region._prot & prot) == prot and region._begin < region._end) {
+                _entries.push_back(Entry { region._begin.get(), region._end.get(), idx });
+                _upper = std::max(_upper, region._end.get());
+            }
+        }
+        // maps are sorted already, saved snapshots may not be
+        if (not std::is_sorted(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) { return a._begin < b._begin; })) {
+            std::sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) { return a._begin < b._begin; });
+        }
+    }
+
+    bool empty() const { return _entries.empty(); }
+
+    // no indexed region holds an address outside [lower(), upper())
+    uintptr_t lower() const { return _entries.empty() ? 0 : _entries.front()._begin; }
+
+    uintptr_t upper() const { return _upper; }
+
+    // index in the list of the region holding [addr, addr + size), npos if there is none
+    size_t find(uintptr_t addr, size_t size = 1) const
+    {
+        auto iter = std::upper_bound(_entries.begin(), _entries.end(), addr,
+            [](uintptr_t addr, const Entry& entry) { return addr < entry._begin; });
+        if (iter == _entries.begin()) {
+            return npos;
+        }
+        --iter;
+        if (addr >= iter->_end or iter->_end - addr < size) {
+            return npos;
+        }
+        return iter->_index;
+    }
+};
+
 } // namespace mypower
 
 #endif
@@ -0,0 +1,144 @@
+#include <cassert>
+#include <iostream>
+#include <set>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kPages = 16;
+constexpr uint32_t kTarget = 0xa5a5f00d;
+
+template <typename Scanner>
+static std::set<uintptr_t> scan(std::shared_ptr<Process>& process, const VMRegion& region, Scanner&& scanner)
+{
+    auto session = std::make_shared<Session>(process, kPageSize);
+    session->update_memory_region(VMRegion::ListType { region });
+    session->scan(scanner, kRegionFlagReadWrite);
+
+    std::set<uintptr_t> addresses {};
+    for (size_t idx = 0; idx < session->U32_size(); ++idx) {
+        addresses.insert(session->U32_at(idx)._addr.get());
+        // matches of all threads are sorted by address
+        assert(idx == 0 or session->U32_at(idx - 1)._addr < session->U32_at(idx)._addr);
+    }
+    for (size_t idx = 0; idx < session->BYTES_size(); ++idx) {
+        addresses.insert(session->BYTES_at(idx)._addr.get());
+    }
+    assert(addresses.size() == session->U32_size() + session->BYTES_size());
+    return addresses;
+}
+
+int main(int argc, char* argv[])
+{
+    auto* memory = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize * kPages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(memory != MAP_FAILED);
+
+    VMRegion region {};
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(memory) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageSize * kPages) };
+    region._prot = kRegionFlagReadWrite;
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+
+    // values straddling every chunk and unit boundary
+    std::set<uintptr_t> expected {};
+    for (size_t page = 1; page < kPages; ++page) {
+        auto* ptr = memory + page * kPageSize - 2;
+        memcpy(ptr, &kTarget, sizeof(kTarget));
+        expected.insert(reinterpret_cast<uintptr_t>(ptr));
+    }
+    // the last position of the region
+    memcpy(memory + kPageSize * kPages - 4, &kTarget, sizeof(kTarget));
+    expected.insert(reinterpret_cast<uintptr_t>(memory + kPageSize * kPages - 4));
+
+    auto unaligned = scan(process, region, ScanComparator<ComparatorEqual<uint32_t>> { { kTarget }, 1 });
+    std::cout << "unaligned: " << unaligned.size() << std::endl;
+    assert(unaligned == expected);
+
+    typeBYTES bytes(4);
+    memcpy(bytes.data(), &kTarget, sizeof(kTarget));
+    auto memmem = scan(process, region, ScanBytes { bytes });
+    std::cout << "bytes: " << memmem.size() << std::endl;
+    assert(memmem == expected);
+
+    // aligned values ending at every boundary
+    memset(memory, 0, kPageSize * kPages);
+    expected.clear();
+    for (size_t page = 1; page <= kPages; ++page) {
+        auto* ptr = memory + page * kPageSize - 4;
+        memcpy(ptr, &kTarget, sizeof(kTarget));
+        expected.insert(reinterpret_cast<uintptr_t>(ptr));
+    }
+
+    auto aligned = scan(process, region, ScanComparator<ComparatorEqual<uint32_t>> { { kTarget }, 4 });
+    std::cout << "aligned: " << aligned.size() << std::endl;
+    assert(aligned == expected);
+
+    // a small range takes a small chunk, from a buffer released before
+    auto& pool = BufferPool::instance();
+    auto buffer = pool.acquire(kPageSize * 8);
+    pool.release(buffer);
+    {
+        MemoryMapper mapper { process, region._begin, region._begin + kPageSize, 4, 4 };
+        assert(mapper.next());
+        assert(reinterpret_cast<uintptr_t>(mapper.end()) - reinterpret_cast<uintptr_t>(mapper.begin()) == kPageSize);
+        assert(reinterpret_cast<uintptr_t>(mapper.begin()) - reinterpret_cast<uintptr_t>(buffer._ptr) < kPageSize * 8);
+        assert(not mapper.next());
+    }
+    buffer = pool.acquire(kPageSize);
+    assert(buffer._size == kPageSize * 8);
+    pool.release(buffer);
+    pool.trim();
+
+    // our own memory is copied, other threads may unmap it while it is scanned
+    {
+        MemoryMapper mapper { process, region._begin, region._end, 4, 4 };
+        assert(not mapper.map(region));
+        assert(mapper.next());
+        assert(mapper.begin() != memory);
+    }
+
+    // shared memory of another process is mapped through map_files
+    auto* shared = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize * kPages, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    assert(shared != MAP_FAILED);
+    memcpy(shared + kPageSize * 3, &kTarget, sizeof(kTarget));
+
+    pid_t child = fork();
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+
+    auto other = std::shared_ptr<Process>(new ProcessLinux { child });
+    for (auto& target : VMRegion::snapshot(child)) {
+        if (target._begin.get() != reinterpret_cast<uintptr_t>(shared)) {
+            continue;
+        }
+        assert(target._shared);
+
+        MemoryMapper mapper { other, target._begin + kPageSize, target._end, 4, 4 };
+        if (not mapper.map(target)) {
+            // map_files needs CAP_SYS_ADMIN
+            std::cout << "map_files: unavailable" << std::endl;
+            break;
+        }
+        assert(mapper.next());
+        assert(mapper.begin() != shared + kPageSize);
+        assert(memcmp(mapper.begin(), shared + kPageSize, kPageSize * (kPages - 1)) == 0);
+        std::cout << "map_files: mapped" << std::endl;
+    }
+
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    munmap(shared, kPageSize * kPages);
+
+    munmap(memory, kPageSize * kPages);
+    return 0;
+}
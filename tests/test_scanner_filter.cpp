@@ -0,0 +1,181 @@
+#include <cassert>
+#include <iostream>
+
+#include <sys/mman.h>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+constexpr size_t kCount = 1024 * 1024;
+constexpr size_t kPageSize = 4096;
+
+// soft-dirty pages are reported by the test instead of the kernel
+struct TrackedProcess : ProcessLinux {
+    std::vector<PageRange> _written {};
+    uint64_t _pass { 0 };
+
+    using ProcessLinux::ProcessLinux;
+
+    uint64_t clear_soft_dirty() override
+    {
+        _written.clear();
+        return ++_pass;
+    }
+
+    uint64_t soft_dirty_pass() const override { return _pass; }
+
+    bool get_dirty_ranges(const VMRegion& region, std::vector<PageRange>& ranges) override
+    {
+        ranges.insert(ranges.end(), _written.begin(), _written.end());
+        return true;
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    auto* memory = reinterpret_cast<uint32_t*>(mmap(nullptr, kCount * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(memory != MAP_FAILED);
+
+    for (size_t idx = 0; idx < kCount; ++idx) {
+        memory[idx] = idx % 3 == 0 ? 7 : 5;
+    }
+
+    VMRegion region {};
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(memory) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kCount) };
+    region._prot = kRegionFlagReadWrite;
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+    auto session = std::make_shared<Session>(process, 64 * 1024);
+    session->update_memory_region(VMRegion::ListType { region });
+
+    session->scan(ScanComparator<ComparatorEqual<uint32_t>> { { 7u }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+    std::cout << session->U32_size() << std::endl;
+    assert(session->U32_size() == (kCount + 2) / 3);
+
+    // unchanged values, over several partitions
+    for (size_t idx = 0; idx < kCount; idx += 6) {
+        memory[idx] = 8;
+    }
+    session->filter<FilterEqual>();
+    std::cout << session->U32_size() << std::endl;
+    assert(session->U32_size() == (kCount + 2) / 6);
+
+    for (size_t idx = 0; idx < session->U32_size(); ++idx) {
+        auto match = session->U32_at(idx);
+        assert(match._addr.get() == reinterpret_cast<uintptr_t>(memory + idx * 6 + 3));
+        assert(match._value == 7);
+    }
+
+    size_t count = 0;
+    for (auto iter = session->U32_begin(); iter != session->U32_end(); ++iter, ++count) {
+        assert(iter->_addr.get() == reinterpret_cast<uintptr_t>(memory + count * 6 + 3));
+    }
+    assert(count == session->U32_size());
+
+    memory[3] = 9;
+    session->filter<FilterNotEqual>(9, 0);
+    assert(session->U32_size() == (kCount + 2) / 6 - 1);
+    assert(session->U32_at(0)._addr.get() == reinterpret_cast<uintptr_t>(memory + 9));
+
+    // most positions match, the chunks switch to bitmaps
+    auto* bytes = reinterpret_cast<uint8_t*>(memory);
+    for (size_t idx = 0; idx < kCount * sizeof(uint32_t); ++idx) {
+        bytes[idx] = idx % 8 == 0 ? 0 : 1 + idx % 200;
+    }
+    session->reset();
+    session->update_memory_region(VMRegion::ListType { region });
+    session->scan(ScanComparator<ComparatorNotEqual<uint8_t>> { { 0 }, 1 }, kRegionFlagReadWrite);
+
+    const auto& dense = session->get<uint8_t>();
+    assert(dense.size() == kCount * sizeof(uint32_t) / 8 * 7);
+    assert(dense.chunks().front().dense());
+    assert(session->U8_at(0)._addr.get() == reinterpret_cast<uintptr_t>(bytes + 1));
+    assert(session->U8_at(7)._addr.get() == reinterpret_cast<uintptr_t>(bytes + 9));
+    assert(session->U8_at(7)._value == 10);
+
+    size_t position = 1;
+    for (auto iter = session->U8_begin(); iter != session->U8_end(); ++iter) {
+        assert(iter->_addr.get() == reinterpret_cast<uintptr_t>(bytes + position));
+        position += position % 8 == 7 ? 2 : 1;
+    }
+
+    // thin again, back to offsets
+    for (size_t idx = 0; idx < kCount * sizeof(uint32_t); ++idx) {
+        if (idx % 8 != 1) {
+            bytes[idx] = 0;
+        }
+    }
+    session->filter<FilterEqual>();
+    assert(dense.size() == kCount * sizeof(uint32_t) / 8);
+    assert(not dense.chunks().front().dense());
+    assert(session->U8_at(0)._addr.get() == reinterpret_cast<uintptr_t>(bytes + 1));
+    assert(session->U8_at(0)._value == 2);
+
+    // only the written pages are read again, page 5 can not be read at all
+    auto tracked = std::make_shared<TrackedProcess>(getpid());
+    auto tracked_process = std::shared_ptr<Process>(tracked);
+    constexpr size_t kPageValues = kPageSize / sizeof(uint32_t);
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageValues * 16) };
+
+    for (bool all : { true, false }) {
+        for (size_t idx = 0; idx < kPageValues * 16; ++idx) {
+            memory[idx] = all or idx % 16 == 0 ? 7 : 5;
+        }
+
+        Session tracked_session { tracked_process, 64 * 1024 };
+        tracked_session.track_dirty_pages(true);
+        tracked_session.update_memory_region(VMRegion::ListType { region });
+        tracked_session.scan(ScanComparator<ComparatorEqual<uint32_t>> { { 7u }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+
+        const auto& matches = tracked_session.get<uint32_t>();
+        const auto size = matches.size();
+        assert(size == (all ? kPageValues * 16 : kPageValues));
+        assert(matches.chunks().front().dense() == all);
+
+        memory[kPageValues * 2] = 8;
+        tracked->_written = { PageRange { VMAddress { reinterpret_cast<uintptr_t>(memory + kPageValues * 2) }, VMAddress { reinterpret_cast<uintptr_t>(memory + kPageValues * 3) } } };
+        assert(mprotect(memory + kPageValues * 5, kPageSize, PROT_NONE) == 0);
+
+        tracked_session.filter<FilterEqual>();
+        assert(matches.size() == size - 1);
+        assert(tracked->_written.empty());
+
+        assert(mprotect(memory + kPageValues * 5, kPageSize, PROT_READ | PROT_WRITE) == 0);
+    }
+
+    // ranges unmapped, or mapped to something else, since the scan lose their matches
+    for (bool all : { true, false }) {
+        for (size_t idx = 0; idx < kPageValues * 16; ++idx) {
+            memory[idx] = all or idx % 16 == 0 ? 7 : 5;
+        }
+
+        Session moved_session { process, 64 * 1024 };
+        moved_session.update_memory_region(VMRegion::ListType { region });
+        moved_session.scan(ScanComparator<ComparatorEqual<uint32_t>> { { 7u }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+        const auto size = moved_session.U32_size();
+
+        // pages 4 to 8 are gone, a file is mapped at 12 to 16
+        VMRegion head = region, tail = region, file = region;
+        head._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageValues * 4) };
+        tail._begin = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageValues * 8) };
+        tail._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageValues * 12) };
+        file._begin = tail._end;
+        file._inode = 1;
+        file._file = "/file";
+
+        assert(moved_session.refresh_memory_region(VMRegion::ListType { head, tail, file }) == size / 2);
+        assert(moved_session.U32_size() == size / 2);
+        for (size_t idx = 0; idx < moved_session.U32_size(); ++idx) {
+            auto page = (moved_session.U32_at(idx)._addr.get() - region._begin.get()) / kPageSize;
+            assert(page < 4 or (page >= 8 and page < 12));
+        }
+
+        moved_session.filter<FilterEqual>();
+        assert(moved_session.U32_size() == size / 2);
+    }
+
+    munmap(memory, kCount * sizeof(uint32_t));
+    return 0;
+}
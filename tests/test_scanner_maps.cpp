@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+
+#include "vmmap.hpp"
+
+using namespace mypower;
+
+// the std::regex parser the hand-written one replaced, kept as reference
+static std::vector<VMRegion> snapshot_regex(const std::string& s)
+{
+    std::regex exp(R"(([0-9a-fA-F]+)-([0-9a-fA-F]+)\s+([rwxps-]{4})\s+([0-9a-f]+)\s+([0-9a-fA-F]+):([0-9a-fA-F]+)\s+(\d+)[ \t\r]*(.*)\n)",
+        std::regex_constants::ECMAScript | std::regex_constants::icase);
+
+    std::vector<VMRegion> regions;
+    for (auto iter = std::sregex_iterator(s.begin(), s.end(), exp); iter != std::sregex_iterator(); ++iter) {
+        auto& match = *iter;
+
+        VMRegion region;
+        region._begin = VMAddress { std::stoul(match[1], 0, 16) };
+        region._end = VMAddress { std::stoul(match[2], 0, 16) };
+
+        const std::string perms = match[3].str();
+        if (perms[0] != '-')
+            region._prot |= kRegionFlagRead;
+        if (perms[1] != '-')
+            region._prot |= kRegionFlagWrite;
+        if (perms[2] != '-')
+            region._prot |= kRegionFlagExec;
+        region._shared = perms[3] == 's';
+
+        region._offset = std::stoull(match[4], 0, 16);
+        region._major = std::stoull(match[5], 0, 16);
+        region._minor = std::stoull(match[6], 0, 16);
+        region._inode = std::stoull(match[7], 0, 10);
+
+        auto name = match[8].str();
+        if (name.size()) {
+            if (name[0] == '/') {
+                auto w = name.find(' ');
+                region._file = name.substr(0, w);
+                if (w != std::string::npos) {
+                    region._desc = name.substr(w);
+                }
+            } else {
+                region._desc = name;
+            }
+        }
+
+        if (not regions.empty() and regions.back()._end == region._begin and region._desc == "[anon:.bss]") {
+            region._file = regions.back()._file;
+            region._android_bss = true;
+        }
+        regions.emplace_back(std::move(region));
+    }
+    return regions;
+}
+
+static void check(const std::string& text)
+{
+    std::istringstream iss { text };
+    auto regions = VMRegion::snapshot(iss);
+    auto expected = snapshot_regex(text);
+
+    assert(regions.size() == expected.size());
+    for (size_t idx = 0; idx < regions.size(); ++idx) {
+        auto& a = regions[idx];
+        auto& b = expected[idx];
+        assert(a._begin == b._begin and a._end == b._end);
+        assert(a._prot == b._prot and a._shared == b._shared);
+        assert(a._offset == b._offset and a._major == b._major and a._minor == b._minor and a._inode == b._inode);
+        assert(a._file == b._file and a._desc == b._desc);
+        assert(a._android_bss == b._android_bss);
+    }
+}
+
+template <typename F>
+static double measure(F&& func)
+{
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[])
+{
+    std::ostringstream self {};
+    self << std::ifstream("/proc/self/maps").rdbuf();
+    check(self.str());
+
+    // the shapes of an Android process, names with spaces and a .bss tail
+    const char* names[] = {
+        "",
+        "/system/lib64/libc.so",
+        "[anon:.bss]",
+        "[anon:libc_malloc]",
+        "/data/app/com.example-1/base.apk (deleted)",
+        "[stack]",
+        "/dev/ashmem/dalvik-main space (region space)",
+    };
+    std::ostringstream oss {};
+    uintptr_t addr = 0x12c00000;
+    for (size_t idx = 0; idx < 15000; ++idx) {
+        auto next = addr + 0x1000 * (1 + idx % 7);
+        oss << std::hex << addr << "-" << next << " " << (idx % 3 ? "rw-p" : "r-xs") << " "
+            << std::setw(8) << std::setfill('0') << idx * 0x1000 << " fd:0" << idx % 16 << " "
+            << std::dec << (idx % 5 ? 0 : 4011 + idx) << (idx % 7 ? "  \t" : "") << names[idx % 7] << "\n";
+        addr = idx % 11 ? next : next + 0x10000;
+    }
+    oss << "garbage line\n";
+    oss << "7f00-7fff r--p 00000000 00:00 0 [tail without newline]";
+    auto text = oss.str();
+    check(text);
+
+    double hand = measure([&] {
+        std::istringstream iss { text };
+        assert(VMRegion::snapshot(iss).size() == 15000);
+    });
+    double regex = measure([&] {
+        assert(snapshot_regex(text).size() == 15000);
+    });
+    std::cout << "15000 regions: " << hand << " ms, regex " << regex << " ms" << std::endl;
+
+    // every address of a region maps back to it, gaps and straddling ranges to none
+    std::istringstream iss { text };
+    auto regions = VMRegion::snapshot(iss);
+    RegionIndex index { regions };
+    for (size_t idx = 0; idx < regions.size(); ++idx) {
+        auto& region = regions[idx];
+        assert(index.find(region._begin.get()) == idx);
+        assert(index.find(region._end.get() - 1) == idx);
+        assert(index.find(region._end.get() - 4, 8) == RegionIndex::npos);
+    }
+    assert(index.find(regions.front()._begin.get() - 1) == RegionIndex::npos);
+    assert(index.find(regions.back()._end.get()) == RegionIndex::npos);
+
+    // saved snapshots may be out of order, only readable and writable ones are indexed
+    std::reverse(regions.begin(), regions.end());
+    RegionIndex writable { regions, kRegionFlagReadWrite };
+    for (size_t idx = 0; idx < regions.size(); ++idx) {
+        auto found = writable.find(regions[idx]._begin.get());
+        assert(found == ((regions[idx]._prot & kRegionFlagWrite) ? idx : RegionIndex::npos));
+    }
+
+    return 0;
+}
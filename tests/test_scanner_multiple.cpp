@@ -0,0 +1,102 @@
+#include <cassert>
+#include <iostream>
+
+#include <sys/mman.h>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+volatile struct [[gnu::packed]] {
+    char padding[4096];
+    uint32_t target32;
+    uint16_t target16;
+    uint16_t padding16;
+    float target_float;
+} data;
+
+int main(int argc, char* argv[])
+{
+    data.target32 = 0x3f4a39;
+    data.target16 = 0x3f4a;
+    data.target_float = 0x3f4a39;
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+
+    auto session = std::make_shared<Session>(process, 4096);
+    session->update_memory_region();
+
+    ScanMultiple scanner { 2 };
+    scanner.add(ScanComparator<ComparatorEqual<uint32_t>> { { 0x3f4a39u }, 2 });
+    scanner.add(ScanComparator<ComparatorEqual<uint16_t>> { { 0x3f4a }, 2 });
+    scanner.add(ScanComparator<ComparatorEqual<float>> { { float(0x3f4a39) }, 2 });
+    session->scan(scanner, kRegionFlagReadWrite);
+
+    std::cout << session->U32_size() << " " << session->U16_size() << " " << session->FLOAT_size() << std::endl;
+    assert(session->U32_size() >= 1);
+    assert(session->U16_size() >= 1);
+    assert(session->FLOAT_size() >= 1);
+
+    data.target32 = 0x200;
+    data.target16 = 0x200;
+    data.target_float = 0x200;
+    session->filter<FilterEqual>(0x200, 0);
+
+    assert(session->U32_size() == 1);
+    assert(session->U32_at(0)._addr.get() == reinterpret_cast<uintptr_t>(&data.target32));
+    assert(session->U16_size() == 1);
+    assert(session->U16_at(0)._addr.get() == reinterpret_cast<uintptr_t>(&data.target16));
+    assert(session->FLOAT_size() == 1);
+    assert(session->FLOAT_at(0)._addr.get() == reinterpret_cast<uintptr_t>(&data.target_float));
+
+    // a value in the last bytes of a region, too narrow for the widest type
+    constexpr size_t kPageSize = 4096;
+    auto* page = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(page != MAP_FAILED);
+    uint32_t last = 0x5a5a3c3c;
+    memcpy(page + kPageSize - sizeof(last), &last, sizeof(last));
+
+    VMRegion region {};
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(page) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(page + kPageSize) };
+    region._prot = kRegionFlagReadWrite;
+
+    Session tail { process, kPageSize };
+    tail.update_memory_region(VMRegion::ListType { region });
+
+    ScanMultiple wide { 4 };
+    wide.add(ScanComparator<ComparatorEqual<uint32_t>> { { last }, 4 });
+    wide.add(ScanComparator<ComparatorEqual<uint64_t>> { { last }, 4 });
+    tail.scan(wide, kRegionFlagReadWrite);
+
+    assert(tail.U32_size() == 1);
+    assert(tail.U32_at(0)._addr.get() == reinterpret_cast<uintptr_t>(page + kPageSize - sizeof(last)));
+    assert(tail.U64_size() == 0);
+
+    munmap(page, kPageSize);
+
+    // the region spans several units, values on the unit boundaries are found once
+    constexpr size_t kPages = 64;
+    auto* units = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize * kPages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(units != MAP_FAILED);
+    const size_t offsets[] = { 0x64, 0x4000, 0x8000, kPageSize * kPages - sizeof(last) };
+    for (auto offset : offsets) {
+        memcpy(units + offset, &last, sizeof(last));
+    }
+
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(units) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(units + kPageSize * kPages) };
+
+    Session split { process, kPageSize };
+    split.update_memory_region(VMRegion::ListType { region });
+    split.scan(wide, kRegionFlagReadWrite);
+
+    std::cout << split.U32_size() << std::endl;
+    assert(split.U32_size() == std::size(offsets));
+    for (size_t idx = 0; idx < std::size(offsets); ++idx) {
+        assert(split.U32_at(idx)._addr.get() == reinterpret_cast<uintptr_t>(units + offsets[idx]));
+    }
+
+    munmap(units, kPageSize * kPages);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <cassert>
+#include <iostream>
+
+#include <sys/mman.h>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kPages = 64;
+constexpr uint32_t kTarget = 0xa5a5f00d;
+
+static bool resident(uint8_t* page)
+{
+    unsigned char vec = 0;
+    assert(mincore(page, kPageSize, &vec) == 0);
+    return vec & 1;
+}
+
+int main(int argc, char* argv[])
+{
+    auto* memory = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize * kPages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(memory != MAP_FAILED);
+
+    VMRegion region {};
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(memory) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageSize * kPages) };
+    region._prot = kRegionFlagReadWrite;
+
+    // pages 5 and 40 hold data, page 20 maps the zero page
+    memcpy(memory + 5 * kPageSize + 8, &kTarget, sizeof(kTarget));
+    memcpy(memory + 40 * kPageSize + 12, &kTarget, sizeof(kTarget));
+    assert(*reinterpret_cast<volatile uint8_t*>(memory + 20 * kPageSize) == 0);
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+
+    std::vector<PageRange> ranges {};
+    assert(process->get_present_ranges(region, ranges));
+    std::cout << "ranges: " << ranges.size() << std::endl;
+    // the zero page can only be told apart when the page frames are visible
+    assert(ranges.size() == 2 or ranges.size() == 3);
+    assert(ranges.front()._begin.get() == reinterpret_cast<uintptr_t>(memory + 5 * kPageSize));
+    assert(ranges.back()._end.get() == reinterpret_cast<uintptr_t>(memory + 41 * kPageSize));
+
+    // file backed and shared memory is never planned
+    region._inode = 1;
+    assert(not process->get_present_ranges(region, ranges));
+    region._inode = 0;
+
+    Session session { process, kPageSize };
+    session.update_memory_region(VMRegion::ListType { region });
+    session.present_pages_only(true);
+    session.scan(ScanComparator<ComparatorEqual<uint32_t>> { { kTarget }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+
+    assert(session.U32_size() == 2);
+    assert(session.U32_at(0)._addr.get() == reinterpret_cast<uintptr_t>(memory + 5 * kPageSize + 8));
+    assert(session.U32_at(1)._addr.get() == reinterpret_cast<uintptr_t>(memory + 40 * kPageSize + 12));
+
+    // the pages in between were not faulted in by the scan
+    assert(not resident(memory + 30 * kPageSize));
+
+    // two present ranges one page apart, each unit stays inside its range
+    auto* near = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize * 16, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(near != MAP_FAILED);
+    memcpy(near + 5 * kPageSize + 8, &kTarget, sizeof(kTarget));
+    memcpy(near + 7 * kPageSize + 12, &kTarget, sizeof(kTarget));
+
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(near) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(near + kPageSize * 16) };
+
+    ranges.clear();
+    assert(process->get_present_ranges(region, ranges));
+    assert(ranges.size() == 2);
+
+    Session gap { process, kPageSize };
+    gap.update_memory_region(VMRegion::ListType { region });
+    gap.present_pages_only(true);
+    gap.scan(ScanComparator<ComparatorEqual<uint32_t>> { { kTarget }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+
+    assert(gap.U32_size() == 2);
+    assert(gap.U32_at(0)._addr.get() == reinterpret_cast<uintptr_t>(near + 5 * kPageSize + 8));
+    assert(gap.U32_at(1)._addr.get() == reinterpret_cast<uintptr_t>(near + 7 * kPageSize + 12));
+    assert(not resident(near + 6 * kPageSize));
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+#include <set>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pointermap.hpp"
+
+using namespace mypower;
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kPages = 64;
+
+// a static base for the chains
+static uintptr_t g_root = 0;
+
+int main(int argc, char* argv[])
+{
+    auto* memory = reinterpret_cast<uintptr_t*>(mmap(nullptr, kPageSize * kPages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(memory != MAP_FAILED);
+    auto base = reinterpret_cast<uintptr_t>(memory);
+
+    // a hole the pointers below must not be indexed for
+    auto* hole = mmap(nullptr, kPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(hole != MAP_FAILED);
+    munmap(hole, kPageSize);
+
+    // root[5] -> a, a[3] -> b, b[8] -> target - 0x8
+    auto* root = memory;
+    auto* a = memory + kPageSize / sizeof(uintptr_t);
+    auto* b = memory + kPageSize * 7 / sizeof(uintptr_t);
+    auto* target = memory + kPageSize * 33 / sizeof(uintptr_t) + 1;
+
+    root[5] = reinterpret_cast<uintptr_t>(a);
+    a[3] = reinterpret_cast<uintptr_t>(b);
+    b[8] = reinterpret_cast<uintptr_t>(target) - 0x8;
+
+    // not pointers
+    memory[100] = 0x1234;
+    memory[101] = reinterpret_cast<uintptr_t>(hole) + 0x10;
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+
+    PointerMap map {};
+    map.build(process, sizeof(uintptr_t));
+    std::cout << "pointers: " << map.size() << std::endl;
+
+    // sorted by value
+    auto [first, last] = map.range(0, UINTPTR_MAX);
+    assert(static_cast<size_t>(last - first) == map.size());
+    for (auto iter = first; iter != last; ++iter) {
+        assert(iter == first or (iter - 1)->_value <= iter->_value);
+        assert(iter->_value != reinterpret_cast<uintptr_t>(hole) + 0x10);
+    }
+
+    // every pointer of the region, nothing else
+    std::set<uintptr_t> expected { reinterpret_cast<uintptr_t>(&root[5]), reinterpret_cast<uintptr_t>(&a[3]), reinterpret_cast<uintptr_t>(&b[8]) };
+    std::set<uintptr_t> found {};
+    for (auto iter = first; iter != last; ++iter) {
+        if (iter->_addr >= base and iter->_addr < base + kPageSize * kPages) {
+            found.insert(iter->_addr);
+        }
+    }
+    assert(found == expected);
+
+    // walk the chain back from the target
+    auto referrer = [&](uintptr_t addr, size_t offset_max) {
+        auto [first, last] = map.referrers(addr, offset_max);
+        for (auto iter = first; iter != last; ++iter) {
+            if (iter->_addr >= base and iter->_addr < base + kPageSize * kPages) {
+                return *iter;
+            }
+        }
+        return PointerMap::Entry { 0, 0 };
+    };
+
+    auto entry = referrer(reinterpret_cast<uintptr_t>(target), 0x100);
+    assert(entry._addr == reinterpret_cast<uintptr_t>(&b[8]));
+    assert(reinterpret_cast<uintptr_t>(target) - entry._value == 0x8);
+
+    // b[8] is 0x40 past the pointer to b
+    entry = referrer(reinterpret_cast<uintptr_t>(&b[8]), 0x100);
+    assert(entry._addr == reinterpret_cast<uintptr_t>(&a[3]));
+
+    // a[3] is 0x18 past the pointer to a, out of reach with a smaller offset
+    assert(referrer(reinterpret_cast<uintptr_t>(&a[3]), 0x10)._addr == 0);
+    entry = referrer(reinterpret_cast<uintptr_t>(&a[3]), 0x18);
+    assert(entry._addr == reinterpret_cast<uintptr_t>(&root[5]));
+
+    // a shorter chain through b
+    root[9] = reinterpret_cast<uintptr_t>(b);
+    map.build(process, sizeof(uintptr_t));
+
+    PointerSearch::Config config {};
+    config._begin = base;
+    config._end = base + kPageSize;
+    config._depth_max = 4;
+    config._offset_max = 0x100;
+    // the maps built before hold pointers to everything the test touches
+    config._fanout_max = SIZE_MAX;
+
+    std::vector<PointerChain> chains {};
+    auto collect = [&](const PointerChain& chain) { chains.push_back(chain); };
+
+    // the shortest chains only
+    PointerSearch search { map, config };
+    assert(search.run(reinterpret_cast<uintptr_t>(target), collect) == PointerSearch::Status::Done);
+    assert(chains.size() == 1);
+    assert(chains[0].base() == reinterpret_cast<uintptr_t>(&root[9]));
+    assert((chains[0]._offsets == std::vector<uintptr_t> { 0x40, 0x8 }));
+    assert(chains[0]._target == reinterpret_cast<uintptr_t>(target));
+
+    // all chains, shortest first
+    chains.clear();
+    config._find_all = true;
+    PointerSearch all { map, config };
+    assert(all.run(reinterpret_cast<uintptr_t>(target), collect) == PointerSearch::Status::Done);
+    assert(chains.size() == 2);
+    assert(chains[0].base() == reinterpret_cast<uintptr_t>(&root[9]));
+    assert(chains[1].base() == reinterpret_cast<uintptr_t>(&root[5]));
+    assert((chains[1]._pointers == std::vector<uintptr_t> { reinterpret_cast<uintptr_t>(&root[5]), reinterpret_cast<uintptr_t>(&a[3]), reinterpret_cast<uintptr_t>(&b[8]) }));
+    assert((chains[1]._offsets == std::vector<uintptr_t> { 0x18, 0x40, 0x8 }));
+
+    // out of nodes
+    config._node_max = 1;
+    PointerSearch limited { map, config };
+    assert(limited.run(reinterpret_cast<uintptr_t>(target), collect) == PointerSearch::Status::NodeLimit);
+
+    // several targets in one search: one in the struct of target, one elsewhere
+    auto* c = memory + kPageSize * 20 / sizeof(uintptr_t);
+    auto* far = memory + kPageSize * 50 / sizeof(uintptr_t);
+    root[12] = reinterpret_cast<uintptr_t>(c);
+    c[2] = reinterpret_cast<uintptr_t>(far);
+    map.build(process, sizeof(uintptr_t));
+
+    chains.clear();
+    config._node_max = size_t(1) << 24;
+    config._find_all = false;
+    PointerSearch targets { map, config };
+    assert(targets.run({ reinterpret_cast<uintptr_t>(target), reinterpret_cast<uintptr_t>(target + 2), reinterpret_cast<uintptr_t>(far + 1) }, collect) == PointerSearch::Status::Done);
+    assert(chains.size() == 3);
+    for (auto& chain : chains) {
+        if (chain._target == reinterpret_cast<uintptr_t>(far + 1)) {
+            assert(chain.base() == reinterpret_cast<uintptr_t>(&root[12]));
+            assert((chain._offsets == std::vector<uintptr_t> { 0x10, 0x8 }));
+        } else if (chain._target == reinterpret_cast<uintptr_t>(target + 2)) {
+            assert(chain.base() == reinterpret_cast<uintptr_t>(&root[9]));
+            assert((chain._offsets == std::vector<uintptr_t> { 0x40, 0x18 }));
+        } else {
+            assert(chain._target == reinterpret_cast<uintptr_t>(target));
+            assert(chain.base() == reinterpret_cast<uintptr_t>(&root[9]));
+        }
+    }
+
+    // saved and loaded back through mmap
+    g_root = reinterpret_cast<uintptr_t>(a);
+    map.build(process, sizeof(uintptr_t));
+    auto path = std::filesystem::temp_directory_path() / ("test_scanner_pointer." + std::to_string(getpid()));
+    auto* other = memory + kPageSize * 40 / sizeof(uintptr_t);
+    map.save(path, { reinterpret_cast<uintptr_t>(target), reinterpret_cast<uintptr_t>(other) }, base, base + kPageSize);
+
+    PointerMap loaded {};
+    loaded.load(path);
+    std::filesystem::remove(path);
+
+    assert(loaded.size() == map.size());
+    assert((loaded.targets() == std::vector<uintptr_t> { reinterpret_cast<uintptr_t>(target), reinterpret_cast<uintptr_t>(other) }));
+    assert(loaded.begin() == base and loaded.end() == base + kPageSize);
+    assert(loaded.regions().size() == map.regions().size());
+    for (size_t idx = 0; idx < map.regions().size(); ++idx) {
+        assert(loaded.regions()[idx]._begin == map.regions()[idx]._begin);
+        assert(loaded.regions()[idx]._file == map.regions()[idx]._file);
+        assert(loaded.regions()[idx]._desc == map.regions()[idx]._desc);
+    }
+    auto [saved_first, saved_last] = loaded.range(0, UINTPTR_MAX);
+    auto [built_first, built_last] = map.range(0, UINTPTR_MAX);
+    assert(std::equal(saved_first, saved_last, built_first, built_last,
+        [](const PointerMap::Entry& x, const PointerMap::Entry& y) { return x._value == y._value and x._addr == y._addr; }));
+
+    // the static base is found again from its module
+    std::string module {};
+    uintptr_t offset = 0;
+    uintptr_t addr = 0;
+    assert(loaded.module_offset(reinterpret_cast<uintptr_t>(&g_root), module, offset));
+    assert(not module.empty() and module.front() == '/');
+    assert(loaded.module_address(module, offset, addr));
+    assert(addr == reinterpret_cast<uintptr_t>(&g_root));
+    std::cout << "module: " << module << "+" << offset << std::endl;
+
+    // chains followed in the loaded map
+    PointerChain chain {};
+    chain._offsets = { 0x18, 0x40, 0x8 };
+    chain._pointers = { reinterpret_cast<uintptr_t>(&g_root), reinterpret_cast<uintptr_t>(&a[3]), reinterpret_cast<uintptr_t>(&b[8]) };
+    PointerChain broken { chain };
+    broken._offsets[1] = 0x48;
+    auto ends = loaded.follow({ reinterpret_cast<uintptr_t>(&g_root), reinterpret_cast<uintptr_t>(&g_root), base + 0x800 }, { &chain, &broken, &chain });
+    assert(ends[0] == reinterpret_cast<uintptr_t>(target));
+    assert(ends[1] != reinterpret_cast<uintptr_t>(target));
+    assert(ends[2] == 0);
+
+    // chains resolved in the process, a moved struct breaks the chain
+    ends = resolve_chains(*process, { &chain, &broken });
+    assert(ends[0] == reinterpret_cast<uintptr_t>(target));
+    assert(ends[1] == 0);
+    a[3] = reinterpret_cast<uintptr_t>(b) + 0x100;
+    ends = resolve_chains(*process, { &chain });
+    assert(ends[0] == 0);
+    g_root = 0;
+    ends = resolve_chains(*process, { &chain });
+    assert(ends[0] == 0);
+
+    munmap(memory, kPageSize * kPages);
+    return 0;
+}
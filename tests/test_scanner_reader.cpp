@@ -0,0 +1,144 @@
+#include <cassert>
+#include <iostream>
+
+#include <sys/mman.h>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kPages = 4096;
+
+int main(int argc, char* argv[])
+{
+    auto* memory = reinterpret_cast<uint8_t*>(mmap(nullptr, kPageSize * kPages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(memory != MAP_FAILED);
+
+    VMRegion region {};
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(memory) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kPageSize * kPages) };
+    region._prot = kRegionFlagReadWrite;
+    VMRegion::ListType regions { region };
+
+    // every other page, so the spans do not merge and exceed IOV_MAX
+    MatchStore<uint32_t> matches {};
+    for (size_t page = 0; page < kPages; page += 2) {
+        for (size_t offset : { size_t { 0 }, size_t { 100 }, kPageSize - 4 }) {
+            uint32_t value = page * kPageSize + offset;
+            memcpy(memory + page * kPageSize + offset, &value, sizeof(value));
+            matches.push_back(reinterpret_cast<uintptr_t>(memory + page * kPageSize + offset), 0);
+        }
+    }
+
+    const size_t unreadable = 1000;
+    // /proc/pid/mem reads PROT_NONE pages, unmap it to fail both backends
+    munmap(memory + unreadable * kPageSize, kPageSize);
+
+    // readable, but known as unreadable and not read again
+    const size_t skipped = 1002;
+    regions.front().add_unreadable(region._begin + skipped * kPageSize, region._begin + (skipped + 1) * kPageSize);
+
+    assert(matches.chunks().size() == 1);
+    auto& chunk = matches.chunks().front();
+
+    auto check = [&](std::shared_ptr<Process> process) {
+        size_t next = 0;
+        size_t missing = 0;
+        MatchReader reader { process, regions, kPages * kPageSize };
+        reader.read(chunk, sizeof(uint32_t), [&](size_t index, const void* ptr) {
+            assert(index == next);
+            next += 1;
+
+            auto offset = chunk.address(index) - reinterpret_cast<uintptr_t>(memory);
+            if (offset / kPageSize == unreadable or offset / kPageSize == skipped) {
+                assert(ptr == nullptr);
+                missing += 1;
+                return;
+            }
+
+            assert(ptr != nullptr);
+            uint32_t value;
+            memcpy(&value, ptr, sizeof(value));
+            assert(value == offset);
+        });
+
+        std::cout << next << " " << missing << std::endl;
+        assert(next == chunk.size());
+        assert(missing == 6);
+
+        // the scan goes on behind the page that fails and records it
+        Session session { process, 64 * 1024 };
+        session.update_memory_region(VMRegion::ListType { region });
+        session.scan(ScanComparator<ComparatorNotEqual<uint32_t>> { { 0 }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+        std::cout << session.U32_size() << std::endl;
+        assert(session.U32_size() == kPages / 2 * 3 - 1 - 3);
+
+        auto& recorded = session.memory_regions().front()._unreadable;
+        assert(recorded.size() == 1);
+        assert(recorded.front()._begin == region._begin + unreadable * kPageSize);
+        assert(recorded.front()._end == region._begin + (unreadable + 1) * kPageSize);
+
+        session.filter<FilterEqual>();
+        assert(session.U32_size() == kPages / 2 * 3 - 1 - 3);
+
+        // out of order and more than IOV_MAX, a merged span with a request that fails
+        ReadBatch batch { 128 };
+        std::vector<uint32_t> values(kPages);
+        for (size_t page = kPages; page-- > 0;) {
+            batch.add(region._begin + page * kPageSize, &values[page], sizeof(uint32_t));
+        }
+        uint64_t pair = 0;
+        auto overlap = batch.add(region._begin + 100, &pair, sizeof(pair));
+        uint64_t across = 0;
+        auto straddle = batch.add(region._begin + unreadable * kPageSize - 4, &across, sizeof(across));
+        batch.submit(*process);
+
+        for (size_t page = 0; page < kPages; ++page) {
+            auto index = kPages - 1 - page;
+            if (page == unreadable) {
+                assert(batch.valid(index) == 0);
+                continue;
+            }
+            assert(batch.ok(index));
+            assert(values[page] == (page % 2 == 0 ? page * kPageSize : 0));
+        }
+        assert(batch.ok(overlap) and pair == 100);
+        assert(not batch.ok(straddle));
+    };
+
+    check(std::shared_ptr<Process>(new ProcessLinux { getpid() }));
+
+    // the same through /proc/self/mem, which fails the page with EIO
+    check(std::shared_ptr<Process>(new ProcessLinuxMem { getpid() }));
+
+    // a dense chunk is refreshed past a page that fails in the middle of it
+    auto* dense = reinterpret_cast<uint32_t*>(mmap(nullptr, kPageSize * 8, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(dense != MAP_FAILED);
+    std::fill(dense, dense + kPageSize * 8 / sizeof(uint32_t), 1);
+
+    VMRegion dense_region {};
+    dense_region._begin = VMAddress { reinterpret_cast<uintptr_t>(dense) };
+    dense_region._end = VMAddress { reinterpret_cast<uintptr_t>(dense) + kPageSize * 8 };
+    dense_region._prot = kRegionFlagReadWrite;
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+    Session session { process, 64 * 1024 };
+    session.update_memory_region(VMRegion::ListType { dense_region });
+    session.scan(ScanComparator<ComparatorNotEqual<uint32_t>> { { 0 }, sizeof(uint32_t) }, kRegionFlagReadWrite);
+    assert(session.U32_size() == kPageSize * 8 / sizeof(uint32_t));
+
+    munmap(reinterpret_cast<uint8_t*>(dense) + kPageSize * 2, kPageSize);
+    std::fill(dense + kPageSize * 3 / sizeof(uint32_t), dense + kPageSize * 8 / sizeof(uint32_t), 2);
+    session.update_matches();
+
+    const size_t per_page = kPageSize / sizeof(uint32_t);
+    assert(session.U32_at(per_page)._value == 1);
+    assert(session.U32_at(per_page * 2)._value == 1);
+    assert(session.U32_at(per_page * 5)._value == 2);
+    assert(session.U32_at(per_page * 8 - 1)._value == 2);
+
+    munmap(dense, kPageSize * 8);
+    munmap(memory, kPageSize * kPages);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+template <typename Comparator>
+static void check(const Comparator& comparator, const std::vector<typename Comparator::Type>& data)
+{
+    typedef typename Comparator::Type T;
+    const size_t blocks = data.size() / simd::kBlockSize;
+
+    std::vector<uint64_t> expected(blocks);
+    for (size_t idx = 0; idx < blocks * simd::kBlockSize; ++idx) {
+        auto value = data[idx];
+        bool hit = comparator(value);
+        if constexpr (std::is_floating_point<T>::value) {
+            hit = hit and not std::isnan(value);
+        }
+        if (hit) {
+            expected[idx / simd::kBlockSize] |= uint64_t(1) << (idx % simd::kBlockSize);
+        }
+    }
+
+    for (auto level : { simd::Level::Generic, simd::Level::SSE2, simd::Level::AVX2, simd::Level::AVX512, simd::Level::NEON }) {
+        if (not simd::level_supported(level)) {
+            continue;
+        }
+        std::vector<uint64_t> masks(blocks);
+        simd::compare(level, comparator, data.data(), blocks, masks.data());
+        if (masks != expected) {
+            std::cerr << "mismatch: " << simd::level_to_string(level) << " " << type_to_string(T {}) << std::endl;
+            assert(false);
+        }
+    }
+}
+
+template <typename T>
+static void check_type()
+{
+    std::mt19937_64 rng { 0x109 };
+    std::vector<T> data(simd::kBlockSize * 16);
+    for (auto& value : data) {
+        value = static_cast<T>(rng() % 8);
+    }
+    if constexpr (std::is_floating_point<T>::value) {
+        data[3] = std::numeric_limits<T>::quiet_NaN();
+    }
+
+    check(ComparatorEqual<T> { 3 }, data);
+    check(ComparatorNotEqual<T> { 3 }, data);
+    check(ComparatorGreaterThen<T> { 3 }, data);
+    check(ComparatorGreaterOrEqual<T> { 3 }, data);
+    check(ComparatorLessThen<T> { 3 }, data);
+    check(ComparatorLessOrEqual<T> { 3 }, data);
+    check(ComparatorRange<T> { 2, 5 }, data);
+    check(ComparatorRange<T, true> { 2, 5 }, data);
+    if constexpr (std::is_integral<T>::value) {
+        check(ComparatorMask<T> { 2, 6 }, data);
+        check(ComparatorMask<T, true> { 2, 6 }, data);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::cout << "SIMD: " << simd::level_to_string(simd::cpu_level()) << std::endl;
+
+#define __CHECK(t) check_type<type##t>();
+    MATCH_TYPES_NUMBER(__CHECK);
+#undef __CHECK
+
+    // hits reported by ScanComparator equal the scalar result, including the tail
+    std::vector<uint32_t> buffer(simd::kBlockSize * 70 + 13);
+    buffer[0] = 7;
+    buffer[simd::kBlockSize * 64 + 1] = 7;
+    buffer[buffer.size() - 1] = 7;
+
+    std::vector<uintptr_t> addresses {};
+    ScanComparator<ComparatorEqual<uint32_t>> scanner { { 7u }, sizeof(uint32_t) };
+    scanner(VMAddress { 0x1000 }, buffer.data(), buffer.data() + buffer.size(), [&](MatchU32&& match) {
+        assert(match._value == 7);
+        addresses.push_back(match._addr.get());
+    });
+    assert(addresses.size() == 3);
+    assert(addresses[0] == 0x1000);
+    assert(addresses[1] == 0x1000 + (simd::kBlockSize * 64 + 1) * sizeof(uint32_t));
+    assert(addresses[2] == 0x1000 + (buffer.size() - 1) * sizeof(uint32_t));
+
+    return 0;
+}
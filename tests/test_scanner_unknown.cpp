@@ -0,0 +1,64 @@
+#include <cassert>
+#include <iostream>
+
+#include <sys/mman.h>
+
+#include "scanner.hpp"
+
+using namespace mypower;
+
+constexpr size_t kCount = 256 * 1024;
+
+int main(int argc, char* argv[])
+{
+    auto* memory = reinterpret_cast<uint32_t*>(mmap(nullptr, kCount * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    assert(memory != MAP_FAILED);
+
+    for (size_t idx = 0; idx < kCount; idx += 64) {
+        memory[idx] = idx;
+    }
+
+    VMRegion region {};
+    region._begin = VMAddress { reinterpret_cast<uintptr_t>(memory) };
+    region._end = VMAddress { reinterpret_cast<uintptr_t>(memory + kCount) };
+    region._prot = kRegionFlagReadWrite;
+
+    auto process = std::shared_ptr<Process>(new ProcessLinux { getpid() });
+    auto session = std::make_shared<Session>(process, 64 * 1024);
+    session->update_memory_region(VMRegion::ListType { region });
+
+    session->scan_unknown(MatchTypeBitU32 | MatchTypeBitU16, sizeof(uint32_t), kRegionFlagReadWrite);
+    std::cout << session->snapshot().size() << " " << session->snapshot().compressed_size() << std::endl;
+    assert(session->size() == 0);
+    assert(session->snapshot().size() >= kCount * sizeof(uint32_t));
+    assert(session->snapshot().compressed_size() < kCount * sizeof(uint32_t) / 4);
+
+    // the last value of the region and one at a block boundary
+    memory[kCount - 1] += 1;
+    memory[64 * 1024] += 1;
+    memory[1] = 0x10000;
+
+    session->filter<FilterGreaterThen>();
+    std::cout << session->U32_size() << " " << session->U16_size() << std::endl;
+    assert(session->snapshot().empty());
+
+    assert(session->U32_size() == 3);
+    assert(session->U32_at(0)._addr.get() == reinterpret_cast<uintptr_t>(memory + 1));
+    assert(session->U32_at(1)._addr.get() == reinterpret_cast<uintptr_t>(memory + 64 * 1024));
+    assert(session->U32_at(1)._value == 64 * 1024 + 1);
+    assert(session->U32_at(2)._addr.get() == reinterpret_cast<uintptr_t>(memory + kCount - 1));
+
+    // the upper half of memory[1] changed
+    assert(session->U16_size() == 2);
+    assert(session->U16_at(0)._addr.get() == reinterpret_cast<uintptr_t>(memory + 64 * 1024));
+    assert(session->U16_at(1)._addr.get() == reinterpret_cast<uintptr_t>(memory + kCount - 1));
+
+    // later filters work on the matches
+    memory[1] = 7;
+    session->filter<FilterEqual>(7, 0);
+    assert(session->U32_size() == 1);
+    assert(session->U16_size() == 0);
+
+    munmap(memory, kCount * sizeof(uint32_t));
+    return 0;
+}